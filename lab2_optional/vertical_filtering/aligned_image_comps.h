@@ -50,7 +50,11 @@ struct my_aligned_image_comp {
           current image component.  This function is implemented in
           "filtering_main.cpp". */
     void horizontal_filter(my_aligned_image_comp* in);
-        /* Implemented in "filtering_main.cpp". */
+       /* Vector implementation of horizontal filtering, mapping `in' to
+          the current image component; `in' must have been boundary
+          extended.  Together with `vector_filter' this performs the same
+          separable filtering as `filter'.  This function is implemented in
+          "vector_filter.cpp". */
     void vector_filter(my_aligned_image_comp *in);
        /* Vector implementation of vertical filtering, using X86 processor
           intrinsics.  This function is implemented in "vector_filter.cpp". */
@@ -168,8 +168,16 @@ int
       for (n=0; n < num_comps; n++)
         output_comps[n].filter(input_comps+n);
 #else
+      my_aligned_image_comp *vertical_comps =
+        new my_aligned_image_comp[num_comps];
       for (n=0; n < num_comps; n++)
-        output_comps[n].vector_filter(input_comps+n);
+        { // Vertical pass, then horizontal pass, both with vectors
+          vertical_comps[n].init(height,width,4); // Border for 2nd pass
+          vertical_comps[n].vector_filter(input_comps+n);
+          vertical_comps[n].perform_boundary_extension();
+          output_comps[n].horizontal_filter(vertical_comps+n);
+        }
+      delete[] vertical_comps;
 #endif
 
       // Write the image back out again
@@ -48,3 +48,41 @@ void my_aligned_image_comp::vector_filter(my_aligned_image_comp *in)
         line_out[c] = sum;
       }
 }
+
+/*****************************************************************************/
+/*                  my_aligned_image_comp::horizontal_filter                 */
+/*****************************************************************************/
+
+void my_aligned_image_comp::horizontal_filter(my_aligned_image_comp *in)
+{
+  // Create the horizontal filter PSF as a local array on the stack.
+  __m128 filter_buf[FILTER_TAPS];
+  __m128 *mirror_psf = filter_buf+FILTER_EXTENT;
+          // `mirror_psf' points to the central tap in the filter
+  for (int t=-FILTER_EXTENT; t <= FILTER_EXTENT; t++)
+    mirror_psf[t] = _mm_set1_ps(1.0F / FILTER_TAPS);
+
+  // Check for consistent dimensions
+  assert(in->border >= FILTER_EXTENT);
+  assert((this->height <= in->height) && (this->width <= in->width));
+  assert(((stride & 3) == 0) && ((in->stride & 3) == 0));
+  int vec_stride_out = this->stride / 4;
+  int vec_width_out = (this->width+3)/4; // Big enough to cover the width
+
+  // Do the filtering.  The window for tap `x' starts `x' samples to the
+  // side of an aligned vector, so it must be read with unaligned loads.
+  // Outputs beyond the width of the image read at most 3 samples beyond
+  // `in''s right border, which still lie within `in''s allocation.
+  __m128 *line_out = (__m128 *) buf;
+  float *line_in = in->buf;
+  for (int r=0; r < height; r++,
+       line_out+=vec_stride_out, line_in+=in->stride)
+    for (int c=0; c < vec_width_out; c++)
+      {
+        float *ip = line_in + 4*c;
+        __m128 sum = _mm_setzero_ps();
+        for (int x=-FILTER_EXTENT; x <= FILTER_EXTENT; x++)
+          sum = _mm_add_ps(sum,_mm_mul_ps(mirror_psf[x],_mm_loadu_ps(ip+x)));
+        line_out[c] = sum;
+      }
+}
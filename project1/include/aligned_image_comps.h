@@ -6,8 +6,168 @@
 // Copyright 2007, David Taubman, The University of New South Wales (UNSW)
 /*****************************************************************************/
 
+#ifndef ALIGNED_IMAGE_COMPS_H
+#define ALIGNED_IMAGE_COMPS_H
+
 #include <assert.h>
+#include <stddef.h>
 #include <string>
+#include "plane_pool.h"
+
+// Default alignment, in bytes, of the first sample of every row, which is
+// also the granularity of `my_aligned_image_comp::stride'.  One cache line
+// suits every vector width up to AVX-512; override with `-D' if required.
+#ifndef MY_COMP_ALIGNMENT
+#  define MY_COMP_ALIGNMENT 64
+#endif
+
+extern float *my_aligned_alloc(size_t num_floats, int alignment);
+  /* Returns a block of `num_floats' floats whose address is a multiple of
+     `alignment' bytes (a power of 2, at least `sizeof(void *)'), using
+     `_aligned_malloc' on Windows and `posix_memalign' elsewhere.  Throws
+     `std::bad_alloc' on failure, like `new'.  The block must be released
+     with `my_aligned_free'.  Implemented in "aligned_image_comps.cpp". */
+
+extern void my_aligned_free(float *block);
+  /* Releases a block obtained from `my_aligned_alloc'; NULL is ignored. */
+
+enum class BoundaryExtensionType {
+    zero_padding,
+    zero_order_hold,
+    symmetric_extension, // x[-n] = x[n]
+    point_symmetric_extension // x[-n] = 2x[0] - x[n]
+  };
+  /* Notes:
+        The same modes as in "lab2", plus point-symmetric extension, which
+     preserves both the value and the slope at the boundary.  Symmetric
+     modes mirror about the edge sample itself, in both directions, and
+     keep reflecting if the border is larger than the image. */
+
+typedef int (*my_row_sink)(void *context, const float *row, int width);
+  /* Callback through which streaming kernels emit each finished output row,
+     in order from the top of the image down.  A non-zero return value is
+     treated as an error code, which stops the kernel and is passed back to
+     its caller. */
+
+/*****************************************************************************/
+/* STRUCT                         my_image_view                              */
+/*****************************************************************************/
+
+struct my_image_view {
+    // Data members: (these occupy space in the structure's block of memory)
+    float *buf; // Points to the first sample of the view; not owned
+    int width;
+    int height;
+    int stride; // Distance, in samples, between successive rows
+    int border; // Samples which may be read beyond each edge of the view
+    // Function members: (these do not occupy any space in memory)
+    my_image_view()
+      { buf = NULL;  width = height = stride = border = 0; }
+    my_image_view(float *buf, int width, int height, int stride,
+                  int border=0)
+      { this->buf = buf;  this->width = width;  this->height = height;
+        this->stride = stride;  this->border = border; }
+    float *row(int r) const
+      { return buf + ((ptrdiff_t) r)*stride; }
+    my_image_view crop(int top, int left, int rows, int cols) const
+      {
+        assert((top >= 0) && (left >= 0) &&
+               ((top+rows) <= height) && ((left+cols) <= width));
+        my_image_view roi(row(top)+left,cols,rows,stride,border+top);
+        int margin = border + left; // Now shrink `border' to the nearest
+        if (margin < roi.border) roi.border = margin; // of the 4 edges
+        margin = border + width - (left+cols);
+        if (margin < roi.border) roi.border = margin;
+        margin = border + height - (top+rows);
+        if (margin < roi.border) roi.border = margin;
+        return roi;
+      }
+    void perform_boundary_extension(BoundaryExtensionType type,
+                                    int num_threads=1);
+       /* Fills the `border' samples around the view, according to `type'.
+          Left and right edges are extended with vector broadcasts or
+          reversing shuffles, and the top and bottom border rows are then
+          written as whole rows with vector moves; both steps are split
+          into `num_threads' stripes.  Only use this on a view which covers
+          a whole component, since the border of a cropped view belongs to
+          its neighbours.  This function is implemented in
+          "aligned_image_comps.cpp", as are all of those below. */
+    void extend_row_edges(BoundaryExtensionType type, int r);
+       /* First step of `perform_boundary_extension', for row `r' alone:
+          fills the `border' samples to its left and right. */
+    void fill_border_row(BoundaryExtensionType type, int k);
+       /* Second step of `perform_boundary_extension': writes the whole of
+          border row `k', border columns included, from rows already
+          extended by `extend_row_edges'.  Rows 0 to `border'-1 are those
+          above the view, working upwards; the rest those below it, working
+          downwards. */
+    void filter(const my_image_view &in);
+       /* Direct implementation of 9x9 separable box filtering, mapping `in'
+          to the current view. */
+    void filter(const my_image_view &in, BoundaryExtensionType ext);
+       /* Border-free form of the above: the edges of `in' are treated as
+          the edges of the image, which is extended virtually according to
+          `ext', so `in' needs no border at all.  See the notes below. */
+    void vector_filter(const my_image_view &in);
+       /* Vector implementation of vertical filtering, using X86 processor
+          intrinsics: SSE2, AVX2 or AVX-512, whichever is the widest the
+          processor offers (see "simd_filter.h").  Neither view need be
+          aligned, and no sample beyond the current view's width is
+          written, so tiles of one image may be filtered side by side. */
+    void vector_filter(const my_image_view &in, BoundaryExtensionType ext);
+       /* Border-free form of the above, like the second `filter'. */
+    void vector_filter_2d(const my_image_view &in);
+       /* Vector implementation of the whole of `filter': each row is
+          filtered vertically into a line buffer by `vector_filter''s
+          kernel, and the line buffer horizontally into the current view,
+          both passes using the widest vectors available. */
+    void vector_filter_2d(const my_image_view &in, BoundaryExtensionType ext);
+       /* Border-free form of the above, like the second `filter'. */
+    void bilinear_interpolation(const my_image_view &in);
+       /* Using bi-linear interpolation to fill the gaps(missing pixels)
+          after expansion by 3. */
+    int bilinear_interpolation(const my_image_view &in, my_row_sink sink,
+                               void *context);
+       /* Streaming form of the above: each output row is passed to `sink'
+          as soon as it is computed, instead of being stored.  The current
+          view is only used to stage one row at a time, so it need only
+          have a single row, 3 times as wide as `in'.  Returns 0 or the
+          first non-zero value returned by `sink'. */
+    void sinc_interpolation(const my_image_view &in, int H); // H means the windowed sinc extent
+        /* for project1 task2. */
+    float* differentiation(const my_image_view &in, float g, std::string mode); // g means output gain
+        /* for project1 task3 and task4.  The returned RGB buffer comes from
+           `plane_pool__take' and must be given back with
+           `plane_pool__release'. */
+    float* derivative_gaussian(const my_image_view &in, float s, std::string mode); // s means sigma in Gaussin FILTER
+        /* for project1 taks6.  The returned buffer is released in the same
+           way as that of `differentiation'. */
+    float* derivative_gaussian(const my_image_view &in, float s, std::string mode,
+                               BoundaryExtensionType ext);
+        /* Border-free form of the above, like the second `filter'. */
+  };
+  /* Notes:
+       A view is a rectangle of samples which belongs to someone else --
+       usually a `my_aligned_image_comp', or some region of one, obtained
+       with `crop'.  Views are cheap to copy and are passed by value or
+       const reference.  `border' records how far kernels may reach outside
+       the view before leaving the underlying memory; for a region cropped
+       from the interior of an image this includes the neighbouring image
+       samples, so that tiles can be filtered in place with no copying or
+       boundary extension of their own.  The kernels read from `in', which
+       must have a large enough `border' for their filter extent, and write
+       only within the current view.
+          The border-free forms of the kernels, which take a
+       `BoundaryExtensionType', never read outside `in'; this saves the
+       memory and the extension pass for a border, which for tall, narrow
+       stripes or wide filters (the derivative of Gaussian reaches up to 18
+       samples) can cost more than the image itself.  Rows and columns far
+       enough from the edges take the same unchecked path as the bordered
+       kernels; only those within the filter extent of an edge read through
+       a small table, built once per call, which maps each position beyond
+       the edge to the sample that stands in for it.  The results equal
+       those of the bordered kernels applied after
+       `perform_boundary_extension' with the same mode. */
 
 /*****************************************************************************/
 /* STRUCT                     my_aligned_image_comp                          */
@@ -17,56 +177,102 @@ struct my_aligned_image_comp {
     // Data members: (these occupy space in the structure's block of memory)
     int width;
     int height;
-    int stride;
+    int stride; // A multiple of `alignment'/4 samples
     int border; // Extra rows/cols to leave around the boundary
+    int alignment; // Bytes; every row of `buf' starts on such a boundary
     float *handle; // Points to start of allocated memory buffer
     float *buf; // Points to the first real image sample
     // Function members: (these do not occupy any space in memory)
     my_aligned_image_comp()
-      { width = height = stride = border = 0;  handle = buf = NULL; }
+      { width = height = stride = border = alignment = 0;
+        handle = buf = NULL; }
+    my_aligned_image_comp(my_aligned_image_comp &&src)
+      { handle = NULL;  *this = static_cast<my_aligned_image_comp &&>(src); }
+    my_aligned_image_comp(const my_aligned_image_comp &) = delete;
+    my_aligned_image_comp &operator=(const my_aligned_image_comp &) = delete;
+    my_aligned_image_comp &operator=(my_aligned_image_comp &&src)
+      {
+        if (&src == this)
+          return *this;
+        if ((handle != NULL) && (handle != src.handle))
+          plane_pool__release(handle);
+        width = src.width;  height = src.height;  stride = src.stride;
+        border = src.border;  alignment = src.alignment;
+        handle = src.handle;  buf = src.buf;
+        src.width = src.height = src.stride = src.border = 0;
+        src.handle = src.buf = NULL;
+        return *this;
+      }
     ~my_aligned_image_comp()
-      { if (handle != NULL) delete[] handle; }
-    void init(int height, int width, int border)
+      { plane_pool__release(handle); }
+    void init(int height, int width, int border,
+              int alignment=MY_COMP_ALIGNMENT)
       {
+        assert((alignment >= 16) && ((alignment & (alignment-1)) == 0));
         this->width = width;  this->height = height;  this->border = border;
+        this->alignment = alignment;
+        int align_samples = alignment / (int) sizeof(float);
         stride = width + 2*border;
-        stride = (stride+3) & ~3; // Make stride a multiple of 4 (16 bytes)
-        if (handle != NULL)
-          delete[] handle; // Delete mem allocated by any previous `init' call
-        handle = new float[stride*(height+2*border)+3]; // Allow for alignment
-        buf = handle + (border*stride) + border;
-        int existing_alignment = (int)(((__int64) buf) & 15);
-        if (existing_alignment != 0)
-          { // Address is not a multiple of 16 bytes already
-            int byte_offset = 16 - existing_alignment;
-            int sample_offset = byte_offset / sizeof(float);
-            assert(byte_offset == (sample_offset * sizeof(float)));
-            buf += sample_offset;
-          }
+        stride = (stride+align_samples-1) & ~(align_samples-1);
+        int lead = (align_samples - (border & (align_samples-1))) &
+          (align_samples-1); // Places `buf' on an `alignment' boundary
+        plane_pool__release(handle); // Memory from any previous `init' call
+        handle = plane_pool__take(((size_t) lead) +
+                                  ((size_t) stride)*(height+2*border),
+                                  alignment);
+        buf = handle + lead + (border*stride) + border;
       }
-    void perform_boundary_extension();
-       // This function is implemented in "filtering_main.cpp".
-    void filter(my_aligned_image_comp *in);
-       /* Direct implementation of vertical filtering, mapping `in' to the
-          current image component.  This function is implemented in
-          "filtering_main.cpp". */
-    void vector_filter(my_aligned_image_comp *in);
-       /* Vector implementation of vertical filtering, using X86 processor
-          intrinsics.  This function is implemented in "vector_filter.cpp". */
-    void bilinear_interpolation(my_aligned_image_comp* in);
-       /* Using bi-linear interpolation to fill the gaps(missing pixels) 
-          after expansion. This function is implemented in aligned_image_comps.cpp. */
-    void sinc_interpolation(my_aligned_image_comp* in, int H); // H means the windowed sinc extent
-        /* for project1 task2. */
-    float* differentiation(my_aligned_image_comp* in, float g, std::string mode); // g means output gain
-        /* for project1 task3 and task4. */
-    float* derivative_gaussian(my_aligned_image_comp* in, float s, std::string mode); // s means sigma in Gaussin FILTER
-        /* for project1 taks6. */
+    my_image_view view() const
+      { return my_image_view(buf,width,height,stride,border); }
+    my_image_view crop(int top, int left, int rows, int cols) const
+      { return view().crop(top,left,rows,cols); }
+    void perform_boundary_extension(BoundaryExtensionType type=
+                                      BoundaryExtensionType::zero_order_hold,
+                                    int num_threads=1)
+      { view().perform_boundary_extension(type,num_threads); }
+    void first_touch(int num_threads);
+       /* Zeroes the whole buffer, border included, split into the same
+          `num_threads' stripes of rows that `run_stripes' would use for
+          `height' rows, each written by the worker for that stripe (the
+          top and bottom border rows go with the first and last stripes).
+          Call this straight after `init' on a multi-socket machine, before
+          anything else touches the buffer, so that each stripe's pages are
+          placed on the NUMA node whose worker will later process it.  Only
+          memory which has never been touched is placed this way; blocks
+          recycled by the plane pool stay where they are.  Implemented in
+          "aligned_image_comps.cpp". */
+    void filter(my_aligned_image_comp *in)
+      { view().filter(in->view()); }
+    void vector_filter(my_aligned_image_comp *in)
+      { view().vector_filter(in->view()); }
+    void vector_filter_2d(my_aligned_image_comp *in)
+      { view().vector_filter_2d(in->view()); }
+    void bilinear_interpolation(my_aligned_image_comp* in)
+      { view().bilinear_interpolation(in->view()); }
+    int bilinear_interpolation(my_aligned_image_comp* in, my_row_sink sink, void* context)
+      { return view().bilinear_interpolation(in->view(),sink,context); }
+    void sinc_interpolation(my_aligned_image_comp* in, int H)
+      { view().sinc_interpolation(in->view(),H); }
+    float* differentiation(my_aligned_image_comp* in, float g, std::string mode)
+      { return view().differentiation(in->view(),g,mode); }
+    float* derivative_gaussian(my_aligned_image_comp* in, float s, std::string mode)
+      { return view().derivative_gaussian(in->view(),s,mode); }
+       /* The kernels above are those of `my_image_view', applied to the
+          whole of the current component and of `in'. */
   };
   /* Notes:
        This class is the same as `my_image_comp' from the "filtering_example"
        project, except that it ensures that the first sample of every image
-       row has a 16-byte aligned address.  This also means that we can access
-       a whole number of 16-byte chunks within each line without crashing
-       into the next line, regardless of the original image dimensions.  These
-       properties are important for fast vector processing. */
\ No newline at end of file
+       row has an address aligned to `alignment' bytes (64 by default, a
+       whole cache line).  This also means that we can access a whole number
+       of `alignment'-byte chunks within each line without crashing into the
+       next line, regardless of the original image dimensions.  These
+       properties are important for fast vector processing: with the default
+       alignment, full-width SSE, AVX2 and AVX-512 loads from the start of
+       any row are all aligned and never split a cache line.
+          Components own their memory, so they may be moved but not copied;
+       a moved-from component is left empty, as if newly constructed.  Use
+       `view' or `crop' to hand all or part of a component to a kernel
+       without copying it. */
+
+#endif // ALIGNED_IMAGE_COMPS_H
@@ -0,0 +1,255 @@
+/*****************************************************************************/
+// File: comp_io.h
+/*****************************************************************************/
+// Conversion between interleaved 8-bit BMP lines and the planar floating
+// point `my_aligned_image_comp' buffers used by the project1 tasks.
+/*****************************************************************************/
+
+#ifndef COMP_IO_H
+#define COMP_IO_H
+
+#include "io_bmp.h"
+#include "io_raw.h"
+#include "io_pnm.h"
+#include "aligned_image_comps.h"
+#include "multi_image_comps.h"
+
+// Structures defined here:
+struct comp_io_async; // Opaque; defined in "comp_io.cpp"
+struct comp_io_row_writer;
+
+extern void comp_io__decode_line(const io_byte *line, int num_comps,
+                                 my_aligned_image_comp *comps, int r);
+  /* Deinterleaves one line of `num_comps' interleaved bytes (BGR order, as
+     delivered by `bmp_in') into row `r' of each of the `num_comps'
+     components, converting to float.  The same pass fills the left and
+     right border columns of the row by zero-order hold.  If `r' is the
+     first or last row of the image, the completed row (border columns
+     included) is also replicated into the top or bottom border rows.  Once
+     every row has been decoded, each component is therefore fully
+     boundary-extended, exactly as if `perform_boundary_extension' had been
+     called, without further passes over memory.
+        `num_comps' may also be 4, for the BGRA lines of a 32-bit file
+     (`bmp_in::pixel_bytes'), in which case only 3 components are written
+     and the alpha samples are discarded.
+        SSSE3 byte shuffles are used when the processor supports them; the
+     components must all have the same dimensions. */
+
+extern int comp_io__read_bmp(bmp_in *in, my_aligned_image_comp *comps);
+  /* Decodes all remaining lines of `in' into `comps' (which must already
+     be initialized with `in->rows' x `in->cols' and one entry for each of
+     the `in->num_components' components) using `comp_io__decode_line'.
+     Works with files opened by either `bmp_in__open' or
+     `bmp_in__open_mapped'.  Returns 0 or one of the `bmp_in' error codes. */
+
+extern int comp_io__read_bmp_parallel(bmp_in *in,
+                                      my_aligned_image_comp *comps,
+                                      int num_threads);
+  /* Same result as `comp_io__read_bmp', but the image is split into
+     `num_threads' horizontal stripes, each of which is fetched with
+     `bmp_in__read_rows' (or straight from the mapping) and decoded by its
+     own thread.  The sequential reading position of `in' is not used or
+     updated.  Returns 0 or the first error encountered by any stripe. */
+
+extern comp_io_async *comp_io__start_read(bmp_in *in,
+                                          my_aligned_image_comp *comps);
+  /* Asynchronous form of `comp_io__read_bmp': returns at once, leaving a
+     background thread to read, convert and boundary-extend the lines while
+     the caller gets on with other work.  Neither `in' nor the decoded rows
+     of `comps' may be touched until `comp_io__wait_lines' says they are
+     ready or `comp_io__finish_read' has been called.  Combined with
+     `bmp_in__start_prefetch', disk reads, conversion and the caller's own
+     processing all proceed concurrently. */
+
+extern int comp_io__wait_lines(comp_io_async *job, int num_lines);
+  /* Blocks until at least `num_lines' lines have been decoded.  Lines are
+     decoded in file order, so for a normal (bottom-up) BMP file the rows
+     from `rows'-`num_lines' to `rows'-1 are then complete, together with
+     their left and right borders; the bottom border is complete once the
+     first line is.  For a top-down file (`in->top_down') it is rows 0 to
+     `num_lines'-1 that are complete.  Returns 0, or the error that stopped
+     decoding early. */
+
+extern int comp_io__finish_read(comp_io_async *job);
+  /* Waits for the background thread to finish, releases `job' and returns
+     the same value as `comp_io__read_bmp' would have. */
+
+extern void comp_io__encode_line(const float * const *planes, int num_planes,
+                                 int width, io_byte *line);
+  /* Inverse of `comp_io__decode_line': rounds `width' samples from each of
+     the `num_planes' (1 or 3) float rows in `planes' to the nearest integer,
+     clamps them to [0,255] and interleaves them into `line' (planes[0]
+     being blue for colour output).  The result is identical to the scalar
+     `(io_byte) std::clamp(x+0.5F,0.0F,255.0F)' conversion, but uses SSE2
+     saturating packs, plus SSSE3 shuffles for the interleaving if
+     available. */
+
+extern void comp_io__encode_samples(const float *src, int num_samples,
+                                    io_byte *dst);
+  /* Same conversion as `comp_io__encode_line', applied to `num_samples'
+     consecutive values which are already interleaved, such as the BGR
+     buffers returned by `my_aligned_image_comp::differentiation' and
+     `my_aligned_image_comp::derivative_gaussian'. */
+
+extern int comp_io__write_bmp(bmp_out *out, const my_aligned_image_comp *comps);
+  /* Writes all remaining lines of `out' from its `out->num_components'
+     components, using `comp_io__encode_line' and `bmp_out__put_lines'.
+     Returns 0 or one of the `bmp_out__put_lines' error codes. */
+
+extern int comp_io__write_bmp_interleaved(bmp_out *out, const float *buf);
+  /* As above, but the samples come from a single interleaved buffer, which
+     holds `out->rows' rows of `out->line_bytes' floats each, from top to
+     bottom. */
+
+extern int comp_io__write_bmp_parallel(bmp_out *out,
+                                       const my_aligned_image_comp *comps,
+                                       int num_threads);
+  /* Same result as `comp_io__write_bmp', but `out' is first switched to
+     positional writing with `bmp_out__preallocate' (unless that has
+     already been done) and the image is split into `num_threads'
+     horizontal stripes, each of which is encoded and written with
+     `bmp_out__write_rows' by its own thread.  If `out' was opened with
+     `bmp_out__open_mapped', each stripe is quantized directly into the
+     mapped rows, with no intermediate buffer or write call.  No lines may
+     have been written to `out' beforehand.  Returns 0 or the first error
+     encountered by any stripe. */
+
+extern int comp_io__write_bmp_interleaved_parallel(bmp_out *out,
+                                                   const float *buf,
+                                                   int num_threads);
+  /* Parallel form of `comp_io__write_bmp_interleaved', working in the same
+     way as `comp_io__write_bmp_parallel'. */
+
+extern int comp_io__read_raw(raw_in *in, my_aligned_image_comp *comps,
+                             int num_threads);
+  /* Counterpart of `comp_io__read_bmp_parallel' for planar float files:
+     copies each plane of `in' straight from the mapping into the
+     corresponding (already initialized) component of `comps' and
+     boundary-extends it, using `num_threads' stripes.  No conversion or
+     rounding takes place.  Returns 0 or `IO_ERR_FILE_NOT_OPEN'. */
+
+extern int comp_io__write_raw(raw_out *out, const my_aligned_image_comp *comps,
+                              int num_threads);
+  /* Copies the `out->num_components' components of `comps' into the
+     planes of the mapped file `out', using `num_threads' stripes.  Samples
+     are stored exactly, without rounding or clamping.  Returns 0 or
+     `IO_ERR_FILE_NOT_OPEN'. */
+
+extern int comp_io__write_raw_interleaved(raw_out *out, const float *buf,
+                                          int num_threads);
+  /* As above, but the samples come from a single buffer in which the
+     `out->num_components' components are interleaved, `out->rows' rows of
+     `out->cols'*`out->num_components' floats each, from top to bottom. */
+
+extern int comp_io__read_pnm(pnm_in *in, my_aligned_image_comp *comps,
+                             int num_threads);
+  /* Counterpart of `comp_io__read_bmp_parallel' for PGM/PPM files.  The
+     RGB samples of a PPM file are delivered in BGR order, so that
+     `comps' is arranged exactly as for a BMP file, and samples are scaled
+     from [0,`in->max_val'] to the nominal [0,255] range used by all the
+     processing code.  For 16-bit files the scaled values keep their
+     fractional part, so nothing is lost.  Returns 0 or the first error
+     encountered by any stripe. */
+
+extern int comp_io__write_pnm(pnm_out *out, const my_aligned_image_comp *comps,
+                              int num_threads);
+  /* Inverse of `comp_io__read_pnm': scales samples from [0,255] to
+     [0,`out->max_val'], rounds and clamps them, and writes all remaining
+     lines of `out'.  Files opened with `pnm_out__open_mapped' are filled
+     in place by `num_threads' threads; others are written sequentially.
+     Returns 0 or one of the `pnm_out__put_lines' error codes. */
+
+extern int comp_io__write_pnm_interleaved(pnm_out *out, const float *buf,
+                                          int num_threads);
+  /* As above, but for an interleaved (BGR) buffer of the kind accepted by
+     `comp_io__write_bmp_interleaved'. */
+
+extern int comp_io__load_image(const char *fname, int border,
+                               my_aligned_image_comp **comps,
+                               int *num_comps, int num_threads);
+  /* Convenience function used by the task executables to read their
+     input, which may be a BMP file, a PGM/PPM file (recognized by
+     `pnm__file_name_matches'), a headerless 8- or 16-bit dump whose layout
+     is appended to the name as described for `pnm__parse_dump_name' or,
+     if `fname' ends in `RAW_FILE_SUFFIX', a planar float file.  Dumps are
+     scaled to the nominal range of 0 to 255, like PGM/PPM samples.  On
+     success, `*comps' points to
+     an array of `*num_comps' components, allocated with `new[]' and
+     initialized with the image dimensions and the requested `border',
+     which have been fully decoded and boundary-extended using
+     `num_threads' threads.  Returns 0 or one of the `IO_ERR_...' codes, in
+     which case `*comps' is NULL.
+        On machines with more than one NUMA node, the components are first
+     touched with `my_aligned_image_comp::first_touch' as soon as they are
+     allocated, in the stripes of `run_stripes' which are also used to
+     decode them; with `numa__set_binding' enabled, the pages therefore end
+     up on the nodes whose workers process the same stripes later. */
+
+extern int comp_io__load_multi_image(const char *fname, int border,
+                                     my_plane_layout layout,
+                                     my_multi_image *image, int num_threads);
+  /* Same as `comp_io__load_image', except that all the components are
+     decoded into the single allocation of `image', which is initialized
+     with the requested `border' and `layout'.  On failure `image' is left
+     empty. */
+
+extern int comp_io__save_image(const char *fname,
+                               const my_aligned_image_comp *comps,
+                               int num_comps, int num_threads);
+  /* Writes `num_comps' components to a new BMP file, rounding and clamping
+     to 8 bits, or to a planar float file if `fname' ends in
+     `RAW_FILE_SUFFIX', in which case the samples are kept exactly.  Names
+     accepted by `pnm__file_name_matches' give a 16-bit PGM/PPM file, which
+     keeps 8 fractional bits of each sample.  All kinds of file are written
+     through memory mappings by `num_threads' threads.  Returns 0 or one of
+     the `IO_ERR_...' codes. */
+
+extern int comp_io__save_interleaved(const char *fname, const float *buf,
+                                     int width, int height, int num_comps,
+                                     int num_threads);
+  /* Same as `comp_io__save_image', but for an interleaved buffer of the
+     kind accepted by `comp_io__write_bmp_interleaved'. */
+
+/*****************************************************************************/
+/*                           comp_io_row_writer                              */
+/*****************************************************************************/
+
+struct comp_io_row_writer {
+    bmp_out *out; // NULL if rows go to `raw' instead
+    raw_out *raw;
+    io_byte *block; // Encoded lines waiting for `bmp_out__put_lines'
+    int block_lines; // Capacity of `block'
+    int num_buffered; // Lines currently held in `block'
+    int next_row; // Next true row index, used only for mapped files
+  };
+
+extern void comp_io__start_rows(comp_io_row_writer *writer, bmp_out *out);
+  /* Prepares `writer' to accept rows for the monochrome file `out', one at
+     a time, through `comp_io__put_row'.  Rows are encoded as they arrive
+     and written in blocks, so a producer which generates rows in file
+     order never needs to hold more than one of them.  For a producer
+     working from the top of the image down, `out' should have been opened
+     with `bmp_out__open_top_down'.  Alternatively, if `out' was opened
+     with `bmp_out__open_mapped', rows are taken to arrive from the top
+     down, whatever the file's line order, and each is encoded straight
+     into its place in the mapping, with no block buffer at all. */
+
+extern void comp_io__start_raw_rows(comp_io_row_writer *writer, raw_out *raw);
+  /* Same as `comp_io__start_rows', except that rows are stored, exactly
+     and from the top down, in the first plane of the planar float file
+     `raw'. */
+
+extern int comp_io__put_row(void *writer, const float *row, int width);
+  /* Encodes one row of `width' floats and queues it for writing.  The
+     `void *' argument (really a `comp_io_row_writer *') gives this
+     function the `my_row_sink' signature, so it can be handed directly to
+     streaming kernels such as `my_aligned_image_comp::bilinear_interpolation'.
+     Returns 0, `IO_ERR_UNSUPPORTED' if `width' does not match the file or
+     the file is not monochrome, `IO_ERR_FILE_NOT_OPEN' if the file already
+     has all its rows, or an error from `bmp_out__put_lines'. */
+
+extern int comp_io__finish_rows(comp_io_row_writer *writer);
+  /* Writes any rows still buffered and releases the writer's memory.
+     Returns 0 or an error from `bmp_out__put_lines'. */
+
+#endif // COMP_IO_H
@@ -0,0 +1,44 @@
+/*****************************************************************************/
+// File: cpu_features.h
+/*****************************************************************************/
+// Run-time detection of the X86 vector instruction sets which may be used
+// beyond the SSE2 baseline, so that one executable can pick the fastest
+// implementation available on the machine it runs on.
+/*****************************************************************************/
+
+#ifndef CPU_FEATURES_H
+#define CPU_FEATURES_H
+
+// Functions which use instructions beyond SSE2 must be marked with one of
+// these, so that GCC/Clang will generate them without global `-m' flags.
+// MSVC accepts all intrinsics unconditionally.
+#if defined(__GNUC__) || defined(__clang__)
+#  define SIMD_TARGET_SSSE3 __attribute__((target("ssse3")))
+#  define SIMD_TARGET_AVX2 __attribute__((target("avx2,fma")))
+#  define SIMD_TARGET_AVX512 __attribute__((target("avx512f,avx2,fma")))
+#else
+#  define SIMD_TARGET_SSSE3
+#  define SIMD_TARGET_AVX2
+#  define SIMD_TARGET_AVX512
+#endif
+
+enum cpu_simd_level {
+    CPU_SIMD_SSE2 = 0, // Always available on the platforms we target
+    CPU_SIMD_SSSE3 = 1,
+    CPU_SIMD_AVX2 = 2, // AVX2 together with FMA
+    CPU_SIMD_AVX512 = 3 // AVX-512F, on top of all the above
+  };
+
+extern int cpu_simd_level();
+  /* Returns the most capable `cpu_simd_level' supported by the processor
+     and enabled by the operating system.  The CPUID instruction is
+     executed only on the first call.
+        For A/B testing, the environment variable `MY_SIMD_LEVEL' may be
+     set to "sse2", "ssse3", "avx2" or "avx512" to cap the level returned;
+     it is read on the first call, and cannot raise the level above what
+     the processor supports. */
+
+extern const char *cpu_simd_level_name(int level);
+  /* Returns the `MY_SIMD_LEVEL' spelling of `level', for reports. */
+
+#endif // CPU_FEATURES_H
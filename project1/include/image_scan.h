@@ -0,0 +1,68 @@
+/*****************************************************************************/
+// File: image_scan.h
+/*****************************************************************************/
+// Support for scheduling batch work over large collections of BMP files:
+// a directory scanner which probes every file's header in parallel, and an
+// estimate of the memory each project1 task needs for a given image, so
+// that batches can be packed to fit the memory available.
+/*****************************************************************************/
+
+#ifndef IMAGE_SCAN_H
+#define IMAGE_SCAN_H
+
+#include <string>
+#include "io_bmp.h"
+
+// Structures defined here:
+struct image_scan_entry;
+
+// Operations whose working set can be estimated
+enum image_op {
+    IMAGE_OP_LOAD, // Just the boundary-extended input components
+    IMAGE_OP_BILINEAR, // Task 1: streaming 3x bilinear expansion
+    IMAGE_OP_SINC, // Task 2: 3x windowed sinc expansion
+    IMAGE_OP_DIFFERENTIATE, // Tasks 3 and 4: gradient magnitude
+    IMAGE_OP_DOG // Task 6: derivative of Gaussian
+  };
+
+extern long long image_op__working_set(image_op op, int width, int height,
+                                       int num_components, int border);
+  /* Returns the number of bytes of sample memory which the task
+     executable for `op' allocates while processing an image with the given
+     dimensions, `border' being the boundary extension it asks
+     `comp_io__load_multi_image' for (4 for task 1, the filter extent H for
+     task 2, 1 for task 3 and 0 for task 6, whose filter extends the image
+     edges virtually).  This counts the input image, held in a single
+     `my_multi_image' buffer, the output component and the task's
+     intermediate buffers, each rounded up as `plane_pool' rounds it (see
+     `plane_pool__block_bytes'); stack, code and the I/O modules' small
+     per-file buffers are ignored. */
+
+/*****************************************************************************/
+/*                            image_scan_entry                               */
+/*****************************************************************************/
+
+struct image_scan_entry {
+    std::string path;
+    int err_code; // 0, or the error returned by `bmp_in__probe'
+    bmp_info info; // Dimensions; all zero if `err_code' is non-zero
+    long long working_set_bytes; // From `image_op__working_set'; 0 on error
+  };
+
+extern int image_scan__directory(const char *dir_name, image_op op,
+                                 int border, int num_threads,
+                                 image_scan_entry **entries,
+                                 int *num_entries);
+  /* Finds every file whose name ends in ".bmp" (in any case) within the
+     directory `dir_name' and its sub-directories, then probes the files'
+     headers with `bmp_in__probe' on `num_threads' threads, filling in one
+     entry per file, in order of path name.  Since probes spend most of
+     their time waiting for the file system, it can pay to use more threads
+     than there are processors.  On success, `*entries' receives an array
+     of `*num_entries' entries, allocated with `new[]', which the caller
+     must `delete[]', and the function returns 0.  Files which cannot be
+     probed still get entries, with non-zero `err_code' values.  Returns
+     `IO_ERR_NO_FILE', leaving `*entries' NULL, if the directory cannot be
+     read. */
+
+#endif // IMAGE_SCAN_H
@@ -12,12 +12,19 @@
 #include <assert.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include "io_sys.h"
 
-// Simple data types
-typedef unsigned long io_uint32;
-typedef long io_int32;
+// Simple data types (the header fields are exactly 32 bits wide, so `long'
+// cannot be used on LP64 platforms)
+typedef unsigned int io_uint32;
+typedef int io_int32;
 typedef unsigned char io_byte;
 
+// Values of `bmp_header::compression' which are understood
+#define BMP_COMPRESSION_NONE      0
+#define BMP_COMPRESSION_RLE8      1 /* Run-length coded 8-bit samples */
+#define BMP_COMPRESSION_BITFIELDS 3 /* 32-bit pixels with colour masks */
+
 // Error codes
 #define IO_ERR_NO_FILE          ((int) -1) /* If file not found */
 #define IO_ERR_FILE_HEADER      ((int) -2) /* If header has an error */
@@ -29,7 +36,10 @@ typedef unsigned char io_byte;
                                               to the end. */
 
 // Structures defined here:
+struct io_stats; // Defined in "io_stats.h"
 struct bmp_header;
+struct bmp_info;
+struct bmp_prefetch; // Opaque; defined in "io_bmp.cpp"
 struct bmp_in_state;
 struct bmp_out_state;
 
@@ -42,7 +52,7 @@ struct bmp_header {
     io_int32 width; // Image width
     io_int32 height; // Image height; -ve means top to bottom.
     io_uint32 planes_bits; // Planes in 16 LSB's (must be 1); bits in 16 MSB's
-    io_uint32 compression; // Only accept 0 here (uncompressed RGB data)
+    io_uint32 compression; // One of the `BMP_COMPRESSION_...' values
     io_uint32 image_size; // Can be 0
     io_int32 xpels_per_metre; // We ignore these
     io_int32 ypels_per_metre; // We ignore these
@@ -57,7 +67,13 @@ struct bmp_header {
      of image sample data.
         If the bit_count is 1, 4 or 8, the structure must be followed by
      a colour lookup table, with 4 bytes per entry, the first 3 of which
-     identify the blue, green and red intensities, respectively. */
+     identify the blue, green and red intensities, respectively.
+        We accept 8-bit samples, either uncompressed or RLE8 coded, 24-bit
+     BGR pixels and 32-bit BGRA pixels.  32-bit pixels may use
+     `BMP_COMPRESSION_BITFIELDS', in which case the red, green and blue
+     masks (each 4 bytes) follow this structure, as they also do in the
+     larger V4 and V5 headers; only the standard masks, 0x00FF0000,
+     0x0000FF00 and 0x000000FF, are accepted. */
 
 /*****************************************************************************/
 /*                                 bmp_in                                    */
@@ -65,24 +81,78 @@ struct bmp_header {
 
 struct bmp_in {
     int num_components, rows, cols;
+    int top_down; // Non-zero if lines are stored from top to bottom
     int num_unread_rows;
+    int pixel_bytes; // 1, 3 or 4 (BGRA); see below
     int line_bytes; // Number of bytes in each line, not including padding
     int alignment_bytes; // Bytes at end of each line to make a multiple of 4.
+    int data_offset; // Location of the first line, relative to file start
     FILE *in;
+    io_mapping map; // Only used if opened with `bmp_in__open_mapped'
+    const io_byte *first_line; // First line in file order, within `map' or
+                               // `expanded'
+    io_byte *expanded; // All samples of an RLE8 file, expanded at open
+    io_byte *scratch; // Padded lines staged by `bmp_in__get_lines'
+    size_t scratch_bytes;
+    bmp_prefetch *prefetch; // Non-NULL after `bmp_in__start_prefetch'
+    io_stats *stats; // Non-NULL if I/O statistics are being collected
   };
+  /* Notes:
+        The lines delivered by the functions below hold `line_bytes' =
+     `pixel_bytes'*`cols' bytes.  For 32-bit files `pixel_bytes' is 4 while
+     `num_components' is 3: each pixel keeps its (ignored) alpha byte, and
+     it is up to the consumer to drop it, as `comp_io__decode_line' does.
+     Otherwise `pixel_bytes' equals `num_components'.
+        RLE8 files cannot be read a line at a time, since lines have no
+     fixed location in the file, so the open functions expand the whole
+     image into `expanded' and close the file; from then on the state
+     behaves exactly as if a mapped, uncompressed file had been opened. */
 
 extern int bmp_in__open(bmp_in *state, const char *fname);
   /* Opens the image file with the indicated name, initializing the supplied
      `state' structure to hold working state information for subsequent use
      with `bmp_in__close()' and `bmp_in__get_line()'.
+        Both bottom-up files and top-down files (negative height in the
+     header) are accepted; `state->rows' is always positive and
+     `state->top_down' records the order in which lines will be read.
         If an error occurs, the function returns one of the error codes
      `IO_ERR_NO_FILE', `IO_ERR_FILE_HEADER', `IO_ERR_FILE_TRUNC' or
-     `IO_ERR_UNSUPPORTED' which are defined at the top of this header file.
-        Otherwise, the function returns 0 for success. */
+     `IO_ERR_UNSUPPORTED' which are defined at the top of this header file,
+     having already released everything it acquired, so `bmp_in__close'
+     need not be called.  Otherwise, the function returns 0 for success. */
+
+extern int bmp_in__open_mapped(bmp_in *state, const char *fname);
+  /* Same as `bmp_in__open', except that the whole file is mapped into
+     memory and `state->in' remains NULL.  The header is checked against the
+     length of the file, so that every line returned by `bmp_in__row_ptr' or
+     `bmp_in__next_line_ptr' is known to lie inside the mapping.
+     `bmp_in__get_line' may still be used with a mapped file; it simply
+     copies from the mapping.  Returns the same error codes as
+     `bmp_in__open'; `IO_ERR_NO_FILE' is also returned if the file exists
+     but cannot be mapped. */
+
+extern int bmp_in__start_prefetch(bmp_in *state, int block_lines,
+                                  int num_blocks);
+  /* Switches a file opened with `bmp_in__open' to asynchronous reading.  A
+     background thread reads all remaining lines, `block_lines' at a time,
+     into a ring of `num_blocks' blocks, staying ahead of the consumer so
+     that disk reads overlap with whatever the caller does between calls to
+     `bmp_in__get_line' or `bmp_in__get_lines', which transparently take
+     their lines from the ring.  The thread has its own scratch buffer and
+     never touches `state' fields other than the file, the ring and the
+     (atomic) I/O statistics, but the caller must not use `state->in'
+     directly until `bmp_in__close' has been called, which stops and joins
+     the thread.
+        For files opened with `bmp_in__open_mapped' the function does
+     nothing, since the operating system already reads ahead into the
+     mapping.  Returns 0, or `IO_ERR_FILE_NOT_OPEN' if the file is not open
+     or prefetching has already been started.  Read errors are reported by
+     the call which consumes the affected lines. */
 
 extern void bmp_in__close(bmp_in *state);
   /* You should use this function to close any image opened with
-     `bmp_in__close'. */
+     `bmp_in__close'.  If the `IO_STATS' environment variable is set, the
+     file's I/O statistics (see "io_stats.h") are reported here. */
 
 extern int bmp_in__get_line(bmp_in *state, io_byte *line);
   /* Reads the next line of image data from the file opened using the most
@@ -94,16 +164,85 @@ extern int bmp_in__get_line(bmp_in *state, io_byte *line);
      file is not currently open, or the end has been reached, the
      `IO_ERR_FILE_NOT_OPEN' error code is returned. */
 
+extern int bmp_in__get_lines(bmp_in *state, io_byte *buf, int num_lines);
+  /* Reads the next `num_lines' lines at once, storing them one after the
+     other in `buf', which must hold `num_lines'*`state->line_bytes' bytes.
+     Lines appear in the same order as successive `bmp_in__get_line' calls
+     would deliver them.  All lines, together with their alignment padding,
+     are fetched with a single read, the padding being stripped in memory.
+        Returns the same error codes as `bmp_in__get_line'; in particular,
+     `IO_ERR_FILE_NOT_OPEN' is returned (and nothing is read) if fewer than
+     `num_lines' lines remain. */
+
+extern int bmp_in__read_rows(bmp_in *state, int first_row, int num_rows,
+                             io_byte *buf);
+  /* Random access counterpart of `bmp_in__get_lines': reads the `num_rows'
+     rows starting from true (top-down) row index `first_row' into `buf',
+     which receives them from the top down, `state->line_bytes' each.  The
+     rows are fetched with one positional read (`pread' or its Windows
+     equivalent) into a buffer private to the call, so any number of
+     threads may read different stripes of the same open file at once.
+     The sequential reading position used by `bmp_in__get_line' and
+     friends is not updated; on Windows, stream-opened files should not be
+     read both ways.  For mapped files the rows are simply copied.
+        Returns 0, `IO_ERR_FILE_TRUNC' if the file is too short, or
+     `IO_ERR_FILE_NOT_OPEN' if the file is not open or the rows are out of
+     range.  Must not be used once `bmp_in__start_prefetch' has been
+     called. */
+
+extern const io_byte *bmp_in__next_line_ptr(bmp_in *state);
+  /* Mapped counterpart of `bmp_in__get_line': returns a pointer to the next
+     line in file order (bottom-up, for a normal BMP file) directly within
+     the mapping, with components interleaved in BGR order.  The pointer
+     remains valid until `bmp_in__close' is called.  Returns NULL if the
+     file was not opened with `bmp_in__open_mapped', or all lines have
+     already been consumed. */
+
+extern const io_byte *bmp_in__row_ptr(bmp_in *state, int r);
+  /* Random access version of `bmp_in__next_line_ptr', which does not
+     affect the sequential reading position.  `r' is the true (top-down)
+     row index, 0 being the top row of the image, so callers need not know
+     how rows are ordered within the file.  Returns NULL if the file was not
+     opened with `bmp_in__open_mapped', or `r' is out of range. */
+
+/*****************************************************************************/
+/*                                bmp_info                                   */
+/*****************************************************************************/
+
+struct bmp_info {
+    int num_components, rows, cols;
+    int top_down; // Non-zero if lines are stored from top to bottom
+    int data_offset; // Location of the first line, relative to file start
+  };
+
+extern int bmp_in__probe(bmp_info *info, const char *fname);
+  /* Lightweight alternative to `bmp_in__open' for callers which only need
+     an image's dimensions: reads just the 54 byte header, with a single
+     positional read, and closes the file again before returning.  Neither
+     the colour table, the colour masks nor the length of the file is
+     examined, so a file which passes this test may still fail in
+     `bmp_in__open'.  Returns 0 or
+     one of the error codes of `bmp_in__open'.  Safe to call from any
+     number of threads at once. */
+
 /*****************************************************************************/
 /*                                bmp_out                                    */
 /*****************************************************************************/
 
 struct bmp_out {
     int num_components, rows, cols;
+    int top_down; // Non-zero if opened with `bmp_out__open_top_down'
     int num_unwritten_rows;
     int line_bytes; // Number of bytes in each line, not including padding
     int alignment_bytes; // Number of 0's at end of each line.
+    int data_offset; // Location of the first line, relative to file start
+    int preallocated; // Non-zero after `bmp_out__preallocate'
     FILE *out;
+    io_mapping map; // Only used if opened with `bmp_out__open_mapped'
+    io_byte *first_line; // First line in file order, within `map'
+    io_byte *scratch; // Padded lines staged by `bmp_out__put_lines'
+    size_t scratch_bytes;
+    io_stats *stats; // Non-NULL if I/O statistics are being collected
   };
 
 extern int bmp_out__open(bmp_out *state, const char *fname,
@@ -117,9 +256,30 @@ extern int bmp_out__open(bmp_out *state, const char *fname,
      cannot be opened, or else `IO_ERR_SUPPORTED' if an illegal combination
      of parameters is supplied. */
 
+extern int bmp_out__open_top_down(bmp_out *state, const char *fname,
+                                  int width, int height, int num_components);
+  /* Same as `bmp_out__open', except that a negative height is recorded in
+     the header, so that lines are written from the top of the image down.
+     This lets producers which generate rows in raster order stream them
+     to the file as they are finished, rather than holding the whole image
+     until its bottom row is known. */
+
+extern int bmp_out__open_mapped(bmp_out *state, const char *fname,
+                                int width, int height, int num_components);
+  /* Same as `bmp_out__open', except that the file is created at its full
+     length and mapped into memory, leaving `state->out' NULL.  Rows can
+     then be produced in place through the pointers returned by
+     `bmp_out__row_ptr', with no staging buffer and no copy through the
+     file system.  `bmp_out__put_line', `bmp_out__put_lines',
+     `bmp_out__preallocate' and `bmp_out__write_rows' all work with mapped
+     files too, copying into the mapping.  Disk space is reserved when the
+     file is created where the file system allows, since a write to the
+     mapping cannot report a full disk.  Returns the same error codes as
+     `bmp_out__open'. */
+
 extern void bmp_out__close(bmp_out *state);
   /* You should use this function to close any image opened with
-     `bmp_in__close'. */
+     `bmp_in__close'.  I/O statistics are reported as for `bmp_in__close'. */
 
 extern int bmp_out__put_line(bmp_out *state, io_byte *line);
   /* Writes the next line of image data to the file opened using the most
@@ -131,4 +291,52 @@ extern int bmp_out__put_line(bmp_out *state, io_byte *line);
      returned.  If the file is not currently open, or the end has been
      reached, the `IO_ERR_FILE_NOT_OPEN' error code is returned. */
 
+extern int bmp_out__put_lines(bmp_out *state, io_byte *buf, int num_lines);
+  /* Writes the next `num_lines' lines, supplied one after the other in
+     `buf' (each `state->line_bytes' long), exactly as that many calls to
+     `bmp_out__put_line' would, but with a single write call.  The
+     alignment padding is inserted in memory.
+        Unlike `bmp_out__put_line', errors are always returned rather than
+     thrown: `IO_ERR_FILE_TRUNC' if the file cannot be written and
+     `IO_ERR_FILE_NOT_OPEN' (with nothing written) if the file is not open
+     or fewer than `num_lines' lines remain to be written. */
+
+extern int bmp_out__preallocate(bmp_out *state);
+  /* Switches `state' from sequential to positional writing.  The header is
+     flushed and the file is extended to its final length straight away,
+     so that the location of every row is fixed and `bmp_out__write_rows'
+     can then fill in the rows in any order, from any number of threads.
+     Must be called before any lines have been written; afterwards
+     `state->num_unwritten_rows' is 0, so `bmp_out__put_line' and
+     `bmp_out__put_lines' refuse further lines.  Returns 0,
+     `IO_ERR_FILE_NOT_OPEN' if the file is not open or lines have already
+     been written, or `IO_ERR_FILE_TRUNC' if the file cannot be extended
+     (e.g., the disk is full). */
+
+extern int bmp_out__write_rows(bmp_out *state, int first_row, int num_rows,
+                               const io_byte *buf);
+  /* Counterpart of `bmp_in__read_rows' for files prepared with
+     `bmp_out__preallocate': writes the `num_rows' rows starting from true
+     (top-down) row index `first_row', supplied from the top down in `buf'
+     (`state->line_bytes' each), with one positional write (`pwrite' or its
+     Windows equivalent).  Any padding or reversal needed for the file's
+     line order is done in a buffer private to the call, so threads may
+     write different stripes of the same file at once.  Rows may be written
+     in any order; rows which are never written read back as zero.
+        Returns 0, `IO_ERR_FILE_TRUNC' if the write fails, or
+     `IO_ERR_FILE_NOT_OPEN' if the file has not been preallocated or the
+     rows are out of range. */
+
+extern io_byte *bmp_out__row_ptr(bmp_out *state, int r);
+  /* For files opened with `bmp_out__open_mapped', returns a writable
+     pointer to true (top-down) row `r' within the mapping, whatever the
+     order of lines in the file.  The `state->line_bytes' samples are
+     followed by `state->alignment_bytes' padding bytes, which are already
+     zero and may also be overwritten (readers ignore them), so kernels can
+     store whole vectors at the end of a row.  Rows written this way are
+     not counted by `state->num_unwritten_rows'; any number of threads may
+     fill different rows at once.  The pointer remains valid until
+     `bmp_out__close' (which commits the mapping to the file) is called.
+     Returns NULL if the file is not mapped or `r' is out of range. */
+
 #endif // IO_BMP_H
@@ -0,0 +1,170 @@
+/*****************************************************************************/
+// File: io_pnm.h
+/*****************************************************************************/
+// Reading and writing of binary Netpbm files: PGM ("P5", monochrome) and
+// PPM ("P6", RGB), with either 8 or 16 bits per sample.  The interface
+// mirrors `bmp_in' and `bmp_out', including the memory-mapped forms.
+// Headerless sample dumps, whose layout is supplied by the caller, are
+// read through `pnm_in' as well.
+/*****************************************************************************/
+
+#ifndef IO_PNM_H
+#define IO_PNM_H
+
+#include "io_bmp.h" // For `io_byte', the `IO_ERR_...' codes and `io_mapping'
+
+// Structures defined here:
+struct pnm_dump_spec;
+struct pnm_in;
+struct pnm_out;
+
+#define PNM_DUMP_SEPARATOR '@'
+
+extern bool pnm__file_name_matches(const char *fname);
+  /* Returns true if `fname' ends with ".pgm", ".ppm" or ".pnm", which is
+     how the task executables decide to use this format. */
+
+/*****************************************************************************/
+/*                              pnm_dump_spec                                */
+/*****************************************************************************/
+
+struct pnm_dump_spec {
+    int width, height;
+    int num_components; // 1 (monochrome) or 3 (RGB)
+    int bit_depth; // 1 to 16; samples above 8 bits occupy 2 bytes
+    bool little_endian; // Byte order of 2-byte samples
+  };
+  /* Notes:
+        Describes a headerless dump: `height' rows from the top of the
+     image down, each holding `width' pixels whose `num_components' samples
+     are interleaved in RGB order, with no padding anywhere.  Samples lie
+     in the range 0 to 2^`bit_depth'-1. */
+
+extern int pnm__parse_dump_name(const char *fname, pnm_dump_spec *spec);
+  /* Recognizes names of the form "<file>@<width>x<height>x<comps>x<bits>",
+     optionally followed by "le" (e.g., "scan.raw@640x480x1x12le"), which
+     is how the task executables are told to read a headerless dump.
+     Returns the length of the "<file>" part, having filled in `spec', or
+     -1 if `fname' does not have this form or describes an unsupported
+     layout.  Without "le", 2-byte samples are big-endian, as in PGM. */
+
+/*****************************************************************************/
+/*                                 pnm_in                                    */
+/*****************************************************************************/
+
+struct pnm_in {
+    int num_components, rows, cols; // 1 component for PGM, 3 for PPM
+    int max_val; // Largest sample value given by the header (1 to 65535)
+    int sample_bytes; // 2 if `max_val' exceeds 255, else 1
+    bool little_endian; // Only for headerless dumps; PGM/PPM is big-endian
+    int num_unread_rows;
+    int line_bytes; // `cols'*`num_components'*`sample_bytes'; no padding
+    int data_offset; // Location of the first line, relative to file start
+    FILE *in;
+    io_mapping map; // Only used if opened with `pnm_in__open_mapped'
+    const io_byte *first_line; // First (top) line, within `map'
+  };
+  /* Notes:
+        Lines are always stored from the top of the image down, so file
+     order and row order coincide.  Every function below which delivers
+     lines supplies the samples exactly as they are stored in the file:
+     components are interleaved in RGB order and 16-bit samples occupy two
+     bytes, most significant byte first unless `little_endian' is set. */
+
+extern int pnm_in__open(pnm_in *state, const char *fname);
+  /* Opens the PGM or PPM file with the indicated name for reading with
+     `pnm_in__get_line' and friends.  Returns 0 on success, or else
+     `IO_ERR_NO_FILE', `IO_ERR_FILE_HEADER' (which includes ASCII "P2"/"P3"
+     files and PBM files) or `IO_ERR_FILE_TRUNC'.  After a failed open the
+     file has already been closed, so `pnm_in__close' need not be called. */
+
+extern int pnm_in__open_mapped(pnm_in *state, const char *fname);
+  /* Same as `pnm_in__open', except that the whole file is mapped into
+     memory and `state->in' remains NULL, as for `bmp_in__open_mapped'.
+     After a failed open nothing remains mapped. */
+
+extern int pnm_in__open_headerless(pnm_in *state, const char *fname,
+                                   const pnm_dump_spec *spec);
+  /* Maps the headerless dump with the indicated name, whose layout is
+     given by `spec', so that it can be read exactly like a file opened
+     with `pnm_in__open_mapped'; `state->max_val' is 2^`bit_depth'-1 and
+     `state->data_offset' is 0.  Returns 0, `IO_ERR_NO_FILE',
+     `IO_ERR_UNSUPPORTED' if `spec' is not a layout described above, or
+     `IO_ERR_FILE_TRUNC' if the file is too short for it; as with the other
+     open functions, nothing remains mapped after a failure. */
+
+extern void pnm_in__close(pnm_in *state);
+  /* Closes any file opened with `pnm_in__open' or `pnm_in__open_mapped'. */
+
+extern int pnm_in__get_line(pnm_in *state, io_byte *line);
+  /* Reads the next line into `line', which must hold `state->line_bytes'
+     bytes.  Returns 0, `IO_ERR_FILE_TRUNC' or `IO_ERR_FILE_NOT_OPEN', as
+     for `bmp_in__get_line'. */
+
+extern int pnm_in__get_lines(pnm_in *state, io_byte *buf, int num_lines);
+  /* Reads the next `num_lines' lines with a single read, exactly as
+     `bmp_in__get_lines' does. */
+
+extern int pnm_in__read_rows(pnm_in *state, int first_row, int num_rows,
+                             io_byte *buf);
+  /* Positional counterpart of `pnm_in__get_lines', with the same thread
+     safety and error codes as `bmp_in__read_rows'. */
+
+extern const io_byte *pnm_in__row_ptr(pnm_in *state, int r);
+  /* Returns a pointer to row `r' within the mapping, or NULL if the file
+     was not opened with `pnm_in__open_mapped' or `r' is out of range. */
+
+/*****************************************************************************/
+/*                                 pnm_out                                   */
+/*****************************************************************************/
+
+struct pnm_out {
+    int num_components, rows, cols;
+    int max_val;
+    int sample_bytes;
+    int num_unwritten_rows;
+    int line_bytes;
+    int data_offset;
+    FILE *out;
+    io_mapping map; // Only used if opened with `pnm_out__open_mapped'
+    io_byte *first_line; // First (top) line, within `map'
+  };
+
+extern int pnm_out__open(pnm_out *state, const char *fname, int width,
+                         int height, int num_components, int max_val);
+  /* Creates a PGM (`num_components'=1) or PPM (`num_components'=3) file,
+     whose header announces the largest sample value `max_val'; values
+     above 255 give a 16-bit file.  Lines are then written from the top
+     down with `pnm_out__put_line' or `pnm_out__put_lines', in the form
+     described for `pnm_in'.  Returns 0, `IO_ERR_NO_FILE' if the file cannot
+     be created, or `IO_ERR_UNSUPPORTED' if the parameters are illegal. */
+
+extern int pnm_out__open_mapped(pnm_out *state, const char *fname, int width,
+                                int height, int num_components, int max_val);
+  /* Same as `pnm_out__open', except that the file is created at its full
+     length and mapped, so that rows can be written in place, in any order
+     and from any number of threads, through `pnm_out__row_ptr'.
+     `pnm_out__put_line' and `pnm_out__put_lines' also work, copying into
+     the mapping. */
+
+extern void pnm_out__close(pnm_out *state);
+  /* Closes any file opened with `pnm_out__open' or `pnm_out__open_mapped'. */
+
+extern int pnm_out__put_line(pnm_out *state, const io_byte *line);
+  /* Writes the next line.  Returns 0, `IO_ERR_FILE_TRUNC' if the file
+     cannot be written, or `IO_ERR_FILE_NOT_OPEN' if the file is not open
+     or all lines have already been written. */
+
+extern int pnm_out__put_lines(pnm_out *state, const io_byte *buf,
+                              int num_lines);
+  /* Writes the next `num_lines' lines with a single write; returns the
+     same codes as `pnm_out__put_line', writing nothing if fewer than
+     `num_lines' lines remain. */
+
+extern io_byte *pnm_out__row_ptr(pnm_out *state, int r);
+  /* Returns a writable pointer to row `r' within the mapping, or NULL if
+     the file was not opened with `pnm_out__open_mapped' or `r' is out of
+     range.  Rows written this way are not counted by
+     `state->num_unwritten_rows'. */
+
+#endif // IO_PNM_H
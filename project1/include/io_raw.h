@@ -0,0 +1,103 @@
+/*****************************************************************************/
+// File: io_raw.h
+/*****************************************************************************/
+// Lossless planar float32 image files, used to pass intermediate results
+// from one task executable to the next without rounding them to 8 bits.
+// Files are always accessed through memory mappings.
+/*****************************************************************************/
+
+#ifndef IO_RAW_H
+#define IO_RAW_H
+
+#include <string.h>
+#include "io_bmp.h" // For the `IO_ERR_...' codes and `io_int32'
+
+// Structures defined here:
+struct raw_header;
+struct raw_in;
+struct raw_out;
+
+/*****************************************************************************/
+/*                               raw_header                                  */
+/*****************************************************************************/
+
+#define RAW_MAGIC "F32P"
+#define RAW_FILE_SUFFIX ".f32"
+
+struct raw_header {
+    char magic[4]; // Must be `RAW_MAGIC'
+    io_int32 header_bytes; // Offset of the first sample; at least 32
+    io_int32 width;
+    io_int32 height;
+    io_int32 num_planes;
+    io_int32 reserved[3]; // Written as 0
+  };
+  /* Notes:
+        The header is followed (at `header_bytes') by `num_planes' planes,
+     one after the other, each holding `height' rows of `width' 32-bit IEEE
+     floats from the top of the image down, with no padding.  Like the
+     header fields, the samples are little-endian, which is the native order
+     on every platform we build for, so the data can be used in place.  For
+     colour images the planes are in the same (BGR) order as the components
+     read from a BMP file. */
+
+inline bool raw__file_name_matches(const char *fname)
+  /* Returns true if `fname' ends with `RAW_FILE_SUFFIX', which is how the
+     task executables decide to use this format rather than BMP. */
+{
+  size_t len = strlen(fname), suffix_len = strlen(RAW_FILE_SUFFIX);
+  return (len >= suffix_len) &&
+    (strcmp(fname+len-suffix_len,RAW_FILE_SUFFIX) == 0);
+}
+
+/*****************************************************************************/
+/*                                 raw_in                                    */
+/*****************************************************************************/
+
+struct raw_in {
+    int num_components, rows, cols;
+    io_mapping map;
+    const float *first_sample; // First sample of plane 0, within `map'
+  };
+
+extern int raw_in__open(raw_in *state, const char *fname);
+  /* Maps the file with the indicated name and checks its header against
+     the length of the file.  Returns 0 if successful, `IO_ERR_NO_FILE' if
+     the file cannot be opened or mapped, `IO_ERR_FILE_HEADER' if it does
+     not start with a valid `raw_header', or `IO_ERR_FILE_TRUNC' if it is
+     too short for the planes its header describes. */
+
+extern void raw_in__close(raw_in *state);
+  /* Unmaps anything opened by `raw_in__open'. */
+
+extern const float *raw_in__row_ptr(raw_in *state, int comp_idx, int r);
+  /* Returns a pointer to row `r' (0 being the top row) of plane
+     `comp_idx', directly within the mapping, or NULL if the file is not
+     open or either index is out of range. */
+
+/*****************************************************************************/
+/*                                 raw_out                                   */
+/*****************************************************************************/
+
+struct raw_out {
+    int num_components, rows, cols;
+    io_mapping map;
+    float *first_sample; // First sample of plane 0, within `map'
+  };
+
+extern int raw_out__open(raw_out *state, const char *fname,
+                         int width, int height, int num_components);
+  /* Creates the file with the indicated name at its full length, writes
+     the header and maps the file so that rows can be written in place
+     through `raw_out__row_ptr', by any number of threads at once.  Any
+     number of components may be written.  Returns 0, `IO_ERR_NO_FILE' if
+     the file cannot be created or mapped, or `IO_ERR_UNSUPPORTED' if the
+     dimensions are not positive. */
+
+extern void raw_out__close(raw_out *state);
+  /* Commits the mapping to the file and closes it. */
+
+extern float *raw_out__row_ptr(raw_out *state, int comp_idx, int r);
+  /* Writable counterpart of `raw_in__row_ptr'. */
+
+#endif // IO_RAW_H
@@ -0,0 +1,98 @@
+/*****************************************************************************/
+// File: io_stats.h
+/*****************************************************************************/
+// Optional per-file counters for the image I/O modules, which show whether
+// a job spends its time waiting for the file system or converting samples.
+// Collection is off unless the `IO_STATS' environment variable is set (to
+// anything other than "0"), or `io_stats__set_enabled' has been called.
+// With `IO_STATS' set, each file's counters are also printed to `stderr'
+// when it is closed.
+/*****************************************************************************/
+
+#ifndef IO_STATS_H
+#define IO_STATS_H
+
+#include <atomic>
+
+// Structures defined here:
+struct io_stats;
+
+extern long long io_clock__ticks();
+  /* Returns a monotonic time stamp, in nanoseconds. */
+
+/*****************************************************************************/
+/*                                io_stats                                   */
+/*****************************************************************************/
+
+struct io_stats {
+    std::atomic<long long> bytes; // Bytes read from or written to the file
+    std::atomic<long long> calls; // Read or write calls issued
+    std::atomic<long long> io_ticks; // Time spent inside those calls
+    std::atomic<long long> wait_ticks; // Time spent waiting for another
+                                       // thread's reads (prefetching)
+    std::atomic<long long> convert_ticks; // Time spent converting samples
+    std::atomic<long long> rows; // Rows delivered or accepted
+    long long open_ticks; // When the file was opened
+    bool mapped; // Mapped files are read or written by page faults, which
+                 // show up as conversion time rather than I/O calls
+    char name[128]; // Tail of the file name, for the report
+  };
+  /* Notes:
+        All counters are atomic, since several threads may work on the
+     same file at once.  Times are in nanoseconds, as returned by
+     `io_clock__ticks'.  A file's counters are found through the `stats'
+     member of `bmp_in' or `bmp_out', which is NULL when statistics are not
+     being collected; in that case the instrumented code does nothing
+     beyond testing that pointer. */
+
+extern void io_stats__set_enabled(bool enable);
+  /* Overrides the `IO_STATS' environment variable for files opened after
+     this call.  Does not affect whether counters are printed. */
+
+extern io_stats *io_stats__create(const char *fname, bool mapped);
+  /* Returns a zeroed set of counters for a file which is being opened, or
+     NULL if statistics are not being collected. */
+
+extern void io_stats__close(io_stats *stats, const char *direction);
+  /* Prints `stats' to `stderr' if the `IO_STATS' environment variable is
+     set, `direction' being "read" or "write", and then destroys it.  Does
+     nothing if `stats' is NULL. */
+
+inline long long io_stats__start(io_stats *stats)
+  /* Returns the time stamp to be passed to one of the functions below, or
+     0 (without reading the clock) if `stats' is NULL. */
+  { return (stats == NULL)?0:io_clock__ticks(); }
+
+inline void io_stats__add_io(io_stats *stats, long long bytes,
+                             long long start_ticks)
+  /* Records a read or write call of `bytes' which began at `start_ticks'. */
+{
+  if (stats == NULL)
+    return;
+  stats->bytes += bytes;
+  stats->calls++;
+  stats->io_ticks += io_clock__ticks() - start_ticks;
+}
+
+inline void io_stats__add_wait(io_stats *stats, long long start_ticks)
+  /* Records time spent blocked on another thread's I/O since
+     `start_ticks'. */
+{
+  if (stats != NULL)
+    stats->wait_ticks += io_clock__ticks() - start_ticks;
+}
+
+inline void io_stats__add_rows(io_stats *stats, long long num_rows)
+{
+  if (stats != NULL)
+    stats->rows += num_rows;
+}
+
+inline void io_stats__add_convert(io_stats *stats, long long start_ticks)
+  /* Records time spent converting samples since `start_ticks'. */
+{
+  if (stats != NULL)
+    stats->convert_ticks += io_clock__ticks() - start_ticks;
+}
+
+#endif // IO_STATS_H
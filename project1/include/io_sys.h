@@ -0,0 +1,84 @@
+/*****************************************************************************/
+// File: io_sys.h
+/*****************************************************************************/
+// Thin portability layer over the operating system's file primitives, used
+// by the image I/O modules.  Windows builds use file mapping objects; all
+// other builds use POSIX `mmap'.
+/*****************************************************************************/
+
+#ifndef IO_SYS_H
+#define IO_SYS_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+// Structures defined here:
+struct io_mapping;
+
+/*****************************************************************************/
+/*                               io_mapping                                  */
+/*****************************************************************************/
+
+struct io_mapping {
+    unsigned char *base; // First byte of the mapped file; NULL if not mapped
+    size_t bytes; // Length of the mapping (equal to the file length)
+#ifdef _WIN32
+    void *file_handle; // Windows `HANDLE' values, kept opaque here
+    void *map_handle;
+#else
+    int fd;
+#endif
+  };
+
+extern int io_mapping__open_read(io_mapping *map, const char *fname);
+  /* Maps the entire file with the indicated name into memory for reading.
+     Returns 0 if successful, or -1 if the file cannot be opened or mapped,
+     in which case `map->base' is left NULL.  Empty files cannot be mapped. */
+
+extern int io_mapping__open_write(io_mapping *map, const char *fname,
+                                  size_t num_bytes);
+  /* Creates (or truncates) the file with the indicated name, sets its
+     length to `num_bytes' (reserving the disk space where the file system
+     allows) and maps all of it into memory for reading and writing.  The
+     new contents are all zero.  Whatever is written through `map->base'
+     reaches the file by the time `io_mapping__close' returns.  Returns 0
+     if successful, or -1 on failure, in which case `map->base' is left
+     NULL. */
+
+extern void io_mapping__close(io_mapping *map);
+  /* Unmaps and closes anything opened by `io_mapping__open_read' or
+     `io_mapping__open_write'.  It is safe to call this function on a
+     zeroed `io_mapping' structure. */
+
+/*****************************************************************************/
+/*                          Positional file access                           */
+/*****************************************************************************/
+
+extern int io_file__pread(FILE *fp, void *buf, size_t num_bytes,
+                          long long offset);
+  /* Reads exactly `num_bytes' from absolute position `offset' in the file
+     underlying the stdio stream `fp', bypassing the stream's buffer and
+     without relying on the shared file position, so any number of threads
+     may call this concurrently on the same `fp'.  On POSIX systems the
+     stream's position is unaffected; on Windows it may move, so positional
+     and sequential reads should not be mixed on one stream.  Reads
+     interrupted by a signal are retried.  Returns 0 on success or -1 if
+     the read fails or the file is too short. */
+
+extern int io_file__pwrite(FILE *fp, const void *buf, size_t num_bytes,
+                           long long offset);
+  /* Writing counterpart of `io_file__pread': writes `num_bytes' at
+     absolute position `offset' in the file underlying `fp', bypassing the
+     stream's buffer, so several threads may write disjoint parts of the
+     file concurrently.  Anything still buffered in `fp' must have been
+     flushed beforehand.  Writes interrupted by a signal are retried.
+     Returns 0 on success or -1 on failure. */
+
+extern int io_file__set_size(FILE *fp, long long num_bytes);
+  /* Flushes `fp' and extends (or truncates) the underlying file to exactly
+     `num_bytes', reserving disk space for it where the file system allows
+     (`posix_fallocate'), so that later positional writes anywhere in the
+     file need not grow it piecemeal.  Returns 0 on success or -1 if the
+     file cannot be resized. */
+
+#endif // IO_SYS_H
@@ -0,0 +1,211 @@
+/*****************************************************************************/
+// File: multi_image_comps.h
+/*****************************************************************************/
+// An image with several components held in a single allocation, laid out
+// either as whole planes one after another or with the rows of the
+// components interleaved (row 0 of every component, then row 1 of every
+// component, and so on).  Kernels which touch all channels of a row at
+// once find them next to each other in the second layout; programs which
+// process a single channel, like the task executables, use the first, so
+// that the channel they work on is one contiguous block.
+/*****************************************************************************/
+
+#ifndef MULTI_IMAGE_COMPS_H
+#define MULTI_IMAGE_COMPS_H
+
+#include "aligned_image_comps.h"
+
+// Structures defined here:
+struct my_multi_row;
+struct my_multi_row_iterator;
+struct my_multi_row_range;
+struct my_multi_image;
+
+enum my_plane_layout {
+    MY_LAYOUT_PLANAR = 0, // Each component's rows, border included, in turn
+    MY_LAYOUT_ROW_INTERLEAVED = 1 // R row, G row, B row, next R row, ...
+  };
+
+/*****************************************************************************/
+/*                               my_multi_row                                */
+/*****************************************************************************/
+
+struct my_multi_row {
+    float *base; // First sample of this row in component 0
+    ptrdiff_t comp_step; // Samples from one component's row to the next's
+    int num_comps;
+    int r; // Row index within the image
+    float *operator[](int n) const
+      { assert((n >= 0) && (n < num_comps)); return base + n*comp_step; }
+  };
+  /* Notes:
+        One row of every component of a `my_multi_image', as delivered by
+     `my_multi_row_iterator'; `row[n]' points to the first real sample of
+     the row in component `n'. */
+
+/*****************************************************************************/
+/*                          my_multi_row_iterator                            */
+/*****************************************************************************/
+
+struct my_multi_row_iterator {
+    my_multi_row row;
+    ptrdiff_t row_step; // Samples from one row of a component to the next
+    const my_multi_row &operator*() const { return row; }
+    const my_multi_row *operator->() const { return &row; }
+    my_multi_row_iterator &operator++()
+      { row.base += row_step;  row.r++;  return *this; }
+    bool operator!=(const my_multi_row_iterator &rhs) const
+      { return row.r != rhs.row.r; }
+    bool operator==(const my_multi_row_iterator &rhs) const
+      { return row.r == rhs.row.r; }
+  };
+
+struct my_multi_row_range {
+    my_multi_row_iterator first, lim;
+    my_multi_row_iterator begin() const { return first; }
+    my_multi_row_iterator end() const { return lim; }
+  };
+  /* Notes:
+        Returned by `my_multi_image::rows', so that a kernel can sweep down
+     the image visiting all channels of each row together:
+       for (const my_multi_row &row : image.rows(first_row,lim_row))
+         for (int n=0; n < row.num_comps; n++)
+           process(row[n],...); */
+
+/*****************************************************************************/
+/*                              my_multi_image                               */
+/*****************************************************************************/
+
+struct my_multi_image {
+    // Data members: (these occupy space in the structure's block of memory)
+    int num_comps;
+    int width;
+    int height;
+    int border; // Extra rows/cols around the boundary of every component
+    int stride; // Samples in one padded row; a multiple of `alignment'/4
+    int alignment; // Bytes; every row of every component is so aligned
+    my_plane_layout layout;
+    ptrdiff_t row_step; // Samples between successive rows of a component
+    ptrdiff_t comp_step; // Samples between the same row of successive comps
+    float *handle; // Block from `plane_pool__take'
+    float *buf; // First real sample of component 0
+    // Function members: (these do not occupy any space in memory)
+    my_multi_image()
+      { num_comps = width = height = border = stride = alignment = 0;
+        layout = MY_LAYOUT_PLANAR;  row_step = comp_step = 0;
+        handle = buf = NULL; }
+    my_multi_image(my_multi_image &&src)
+      { handle = NULL;  *this = static_cast<my_multi_image &&>(src); }
+    my_multi_image(const my_multi_image &) = delete;
+    my_multi_image &operator=(const my_multi_image &) = delete;
+    my_multi_image &operator=(my_multi_image &&src)
+      {
+        if (&src == this)
+          return *this;
+        if ((handle != NULL) && (handle != src.handle))
+          plane_pool__release(handle);
+        num_comps = src.num_comps;  width = src.width;  height = src.height;
+        border = src.border;  stride = src.stride;
+        alignment = src.alignment;  layout = src.layout;
+        row_step = src.row_step;  comp_step = src.comp_step;
+        handle = src.handle;  buf = src.buf;
+        src.num_comps = src.width = src.height = src.border = src.stride = 0;
+        src.handle = src.buf = NULL;
+        return *this;
+      }
+    ~my_multi_image()
+      { plane_pool__release(handle); }
+    void init(int num_comps, int height, int width, int border,
+              my_plane_layout layout=MY_LAYOUT_ROW_INTERLEAVED,
+              int alignment=MY_COMP_ALIGNMENT)
+      {
+        assert((alignment >= 16) && ((alignment & (alignment-1)) == 0));
+        assert(num_comps > 0);
+        this->num_comps = num_comps;  this->width = width;
+        this->height = height;  this->border = border;
+        this->layout = layout;  this->alignment = alignment;
+        int align_samples = alignment / (int) sizeof(float);
+        stride = width + 2*border;
+        stride = (stride+align_samples-1) & ~(align_samples-1);
+        int lead = (align_samples - (border & (align_samples-1))) &
+          (align_samples-1); // Places `buf' on an `alignment' boundary
+        ptrdiff_t padded_rows = height + 2*border;
+        if (layout == MY_LAYOUT_PLANAR)
+          { row_step = stride;  comp_step = stride * padded_rows; }
+        else
+          { row_step = ((ptrdiff_t) stride) * num_comps;  comp_step = stride; }
+        plane_pool__release(handle); // Memory from any previous `init' call
+        handle = plane_pool__take(((size_t) lead) +
+                                  ((size_t) stride)*padded_rows*num_comps,
+                                  alignment);
+        buf = handle + lead + border*row_step + border;
+      }
+    float *row(int n, int r) const
+      { return buf + n*comp_step + r*row_step; }
+    my_image_view comp(int n) const
+      {
+        assert((n >= 0) && (n < num_comps));
+        return my_image_view(buf+n*comp_step,width,height,(int) row_step,
+                             border);
+      }
+    my_multi_row_range rows(int first_row, int lim_row) const
+      {
+        my_multi_row_range range;
+        range.first.row.base = row(0,first_row);
+        range.first.row.comp_step = comp_step;
+        range.first.row.num_comps = num_comps;
+        range.first.row.r = first_row;
+        range.first.row_step = row_step;
+        range.lim = range.first;
+        range.lim.row.r = lim_row;
+        return range;
+      }
+    my_multi_row_range rows() const
+      { return rows(0,height); }
+    void alias_comps(my_aligned_image_comp *comps) const
+      {
+        for (int n=0; n < num_comps; n++)
+          {
+            comps[n] = my_aligned_image_comp();
+            comps[n].width = width;  comps[n].height = height;
+            comps[n].border = border;  comps[n].alignment = alignment;
+            comps[n].stride = (int) row_step;  comps[n].buf = row(n,0);
+          }
+      }
+    void first_touch(int num_threads);
+       /* Same as `my_aligned_image_comp::first_touch', for all components:
+          the worker for each stripe of rows zeroes those rows of every
+          component, so that they are placed on that worker's NUMA node.
+          In the row-interleaved layout each stripe is one contiguous
+          range of memory. */
+    void perform_boundary_extension(BoundaryExtensionType type=
+                                      BoundaryExtensionType::zero_order_hold,
+                                    int num_threads=1);
+       /* Same as `my_image_view::perform_boundary_extension' on every
+          component, but in one sweep down the image split between
+          `num_threads' threads: all channels of a row are extended
+          together, as they are visited by the row iterators.  Implemented
+          in "multi_image_comps.cpp", as are the functions above and
+          below. */
+    void vector_filter(const my_multi_image &in, int num_threads=1);
+       /* Applies `my_image_view::vector_filter' to every component of `in',
+          writing the corresponding components of the current image, in a
+          single sweep down the image: each output row is finished for all
+          channels before the next is begun, so the input rows of all the
+          channels are brought into the cache together.  Both images must
+          have the same number of components, and the rows are split
+          between `num_threads' threads. */
+  };
+  /* Notes:
+        Every component has the same dimensions and border and is reached
+     through `comp', which returns an ordinary `my_image_view', so every
+     view kernel works unchanged on either layout; in the row-interleaved
+     layout the view's stride is simply `num_comps' times larger.  Row `r'
+     of component `n' starts at `buf' + `n'*`comp_step' + `r'*`row_step'.
+        `alias_comps' fills `comps'[0] to `comps'[num_comps-1] with
+     non-owning descriptions of the components (their `handle' is NULL),
+     so that functions written for arrays of `my_aligned_image_comp', such
+     as the readers in "comp_io.h", can fill the image directly.  The
+     aliases must not be `init'ed and must not outlive the image. */
+
+#endif // MULTI_IMAGE_COMPS_H
@@ -0,0 +1,60 @@
+/*****************************************************************************/
+// File: numa_placement.h
+/*****************************************************************************/
+// Support for machines with several NUMA nodes (typically one per socket).
+// Operating systems place each page of memory on the node of the thread
+// which first touches it, so planes are first touched stripe by stripe by
+// the same workers that later process those stripes.  Optionally, the
+// stripe workers of `run_stripes' are also bound to nodes, so that stripe
+// `s' runs on the same node every time and finds its memory there.
+/*****************************************************************************/
+
+#ifndef NUMA_PLACEMENT_H
+#define NUMA_PLACEMENT_H
+
+// Structures defined here:
+struct numa_stripe_binding;
+
+extern int numa__num_nodes();
+  /* Returns the number of NUMA nodes with processors, or 1 if the system
+     has only one or cannot say.  The answer is worked out on first use,
+     from the nodes listed as online; memory-only nodes are not counted
+     and gaps in the system's node numbering are allowed. */
+
+extern void numa__set_binding(bool enable);
+  /* Enables or disables the binding of stripe workers to nodes, which is
+     off by default unless the environment variable `MY_NUMA_BIND' is set
+     to "1" or "on" (it is read on first use; calling this function
+     overrides it).  Binding has no effect on single-node machines. */
+
+extern bool numa__binding_enabled();
+  /* True if binding is enabled and there is more than one node. */
+
+inline int numa__stripe_node(int s, int num_stripes)
+  /* Returns the node to which stripe `s' of `num_stripes' is assigned:
+     consecutive stripes share a node, the nodes taking equal shares.  The
+     result counts nodes with processors from 0, which need not be the
+     system's own node number. */
+{
+  return (int)((((long long) s) * numa__num_nodes()) / num_stripes);
+}
+
+/*****************************************************************************/
+/*                           numa_stripe_binding                             */
+/*****************************************************************************/
+
+struct numa_stripe_binding {
+    numa_stripe_binding(int s, int num_stripes);
+    ~numa_stripe_binding();
+  private: // Data
+    bool bound;
+    unsigned char saved[128]; // Previous affinity, in a system-defined form
+  };
+  /* Notes:
+        While an object of this class exists, the calling thread is
+     restricted to the processors of node `numa__stripe_node(s,num_stripes)'
+     if `numa__binding_enabled'; otherwise it does nothing.  The thread's
+     previous affinity is restored by the destructor, which matters for the
+     stripe that `run_stripes' runs on the calling thread. */
+
+#endif // NUMA_PLACEMENT_H
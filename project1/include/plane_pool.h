@@ -0,0 +1,77 @@
+/*****************************************************************************/
+// File: plane_pool.h
+/*****************************************************************************/
+// Recycling allocator for image planes and scratch buffers.  Blocks handed
+// back with `plane_pool__release' are kept, sorted into size classes, and
+// handed out again by later calls to `plane_pool__take' for a similar size,
+// so that code which processes one frame after another stops returning its
+// large buffers to the operating system and paying for fresh, unmapped
+// pages on every frame.  Each thread keeps a few blocks of every class to
+// itself, so that the common case takes no lock at all.  Very large blocks
+// are mapped on 2 MB boundaries and backed by huge pages where the system
+// allows, so that column-wise walks through big planes miss in the TLB far
+// less often.
+/*****************************************************************************/
+
+#ifndef PLANE_POOL_H
+#define PLANE_POOL_H
+
+#include <stddef.h>
+
+extern float *plane_pool__take(size_t num_floats, int alignment);
+  /* Returns a block of at least `num_floats' floats whose address is a
+     multiple of `alignment' bytes (a power of 2, at least 16).  The
+     contents are undefined.  A pooled block of the right size class is
+     reused if there is one; otherwise the block comes from
+     `my_aligned_alloc' or, if it reaches the huge page threshold (see
+     `plane_pool__set_huge_threshold'), is mapped directly from the
+     operating system with a request for huge pages.  Throws
+     `std::bad_alloc' if memory is exhausted.  Blocks must be returned
+     with `plane_pool__release', never freed directly.  Any number of
+     threads may call this function at once. */
+
+extern size_t plane_pool__block_bytes(size_t num_floats, int alignment);
+  /* Returns the number of bytes of memory occupied by a block obtained
+     from `plane_pool__take' with the same arguments: the request rounded
+     up to its size class (up to a quarter more), plus the block's header,
+     or rounded up to whole huge pages if the block reaches the huge page
+     threshold.  Used to estimate how much memory a job will need. */
+
+extern void plane_pool__release(float *block);
+  /* Returns a block obtained from `plane_pool__take' to the pool, from
+     which it may be taken again by any thread.  If the pool already holds
+     more idle memory than the limit set by `plane_pool__set_limit', the
+     block is freed instead.  NULL is ignored. */
+
+extern void plane_pool__set_limit(size_t max_idle_bytes);
+  /* Sets the amount of idle memory which the pool may hold on to, 1 GB by
+     default.  A limit of 0 disables pooling altogether.  Blocks which are
+     already idle are kept until `plane_pool__trim' is called. */
+
+extern void plane_pool__trim();
+  /* Frees every idle block held in the shared pool and in the calling
+     thread's own cache.  Other threads' caches are emptied when those
+     threads exit. */
+
+extern void plane_pool__set_huge_threshold(size_t min_bytes);
+  /* New blocks of at least `min_bytes' are backed by huge pages where
+     possible: on Linux they are aligned to 2 MB and marked with
+     `madvise(MADV_HUGEPAGE)', so that transparent huge pages are used even
+     when the system only enables them on request; on Windows they use
+     large pages if the process holds the "lock pages in memory" privilege.
+     A value of 0 disables huge pages.  The default of 32 MB may also be
+     set with the environment variable `PLANE_POOL_HUGE_PAGES' -- "off",
+     "on" or a byte count such as "8M" -- which is read when the first
+     block is allocated; calling this function overrides it. */
+
+extern long long plane_pool__huge_page_bytes(const float *block);
+  /* Returns the number of bytes of the block obtained from
+     `plane_pool__take' which are currently backed by huge pages: 0 if
+     huge pages were not requested or were refused, or -1 if this cannot
+     be determined.  On Linux the kernel only provides huge pages as they
+     are first touched, and only if it has contiguous memory to hand, so
+     call this after the block has been written; the figure may then be
+     less than the block size, or 0 if transparent huge pages are disabled
+     altogether ("never" in /sys/kernel/mm/transparent_hugepage/enabled). */
+
+#endif // PLANE_POOL_H
@@ -0,0 +1,37 @@
+/*****************************************************************************/
+// File: simd_filter.h
+/*****************************************************************************/
+// Row kernels for the two passes of a separable filter, built for SSE2,
+// SSSE3 (horizontal pass only), AVX2 with FMA, and AVX-512, one of which
+// is chosen on first use according to `cpu_simd_level' (so
+// `MY_SIMD_LEVEL' may be used to compare them).  Kernels elsewhere build
+// their filters out of these.
+/*****************************************************************************/
+
+#ifndef SIMD_FILTER_H
+#define SIMD_FILTER_H
+
+extern void simd_filter__vertical(float *out, const float * const *src,
+                                  const float *taps, int num_taps,
+                                  int width);
+  /* Sets `out'[c] = sum over t of `taps'[t] * `src'[t][c], for c from 0 to
+     `width'-1; `src' holds the `num_taps' input rows, top row first.  No
+     address need be aligned, and nothing beyond `out'[width-1] is
+     written. */
+
+extern void simd_filter__horizontal(float *out, const float *in,
+                                    const float *taps, int extent,
+                                    int width);
+  /* Sets `out'[c] = sum over x of `taps'[x] * `in'[c+x], for c from 0 to
+     `width'-1 and x from -`extent' to `extent'; `taps' points to the
+     central tap, and `in'[-extent] to `in'[width-1+extent] are read, so
+     the row must have that much border (or be the middle of a longer
+     row).  `out' and `in' must not overlap.  If `in' is 16-byte aligned,
+     the SSSE3 kernel reads the whole aligned blocks of 4 samples which
+     contain those, which can never fault; the others use unaligned loads
+     (or masked ones) and read nothing more. */
+
+extern int simd_filter__level();
+  /* Returns the `cpu_simd_level' whose kernels the above functions use. */
+
+#endif // SIMD_FILTER_H
@@ -0,0 +1,64 @@
+/*****************************************************************************/
+// File: thread_stripes.h
+/*****************************************************************************/
+// Minimal support for running row-oriented work on several threads, each
+// thread taking one horizontal stripe of the image.
+/*****************************************************************************/
+
+#ifndef THREAD_STRIPES_H
+#define THREAD_STRIPES_H
+
+#include <thread>
+#include <vector>
+#include "numa_placement.h"
+
+/*****************************************************************************/
+/* INLINE                      default_num_threads                           */
+/*****************************************************************************/
+
+inline int default_num_threads()
+  /* Returns the number of hardware threads, or 1 if this is unknown. */
+{
+  int n = (int) std::thread::hardware_concurrency();
+  return (n > 0)?n:1;
+}
+
+/*****************************************************************************/
+/* TEMPLATE                         run_stripes                              */
+/*****************************************************************************/
+
+template<class Fn> void
+  run_stripes(int num_rows, int num_threads, Fn fn)
+  /* Splits rows 0 to `num_rows'-1 into at most `num_threads' contiguous
+     stripes of (nearly) equal height and calls `fn(first_row,lim_row,s)'
+     for each stripe `s', where `lim_row' is one beyond the stripe's last
+     row.  All but the last stripe run on new threads; the last runs on the
+     calling thread.  Returns once every stripe has been processed.  If
+     `numa__binding_enabled', each stripe runs on the processors of node
+     `numa__stripe_node(s,num_threads)', so that a given stripe of a given
+     image always runs on the same node. */
+{
+  if (num_threads > num_rows)
+    num_threads = num_rows;
+  if (num_threads < 1)
+    num_threads = 1;
+  auto bound_fn = [&fn,num_threads](int first_row, int lim_row, int s)
+    {
+      numa_stripe_binding binding(s,num_threads);
+      fn(first_row,lim_row,s);
+    };
+  std::vector<std::thread> workers;
+  for (int s=0; s < num_threads; s++)
+    {
+      int first_row = (int)((((long long) num_rows) * s) / num_threads);
+      int lim_row = (int)((((long long) num_rows) * (s+1)) / num_threads);
+      if (s == (num_threads-1))
+        bound_fn(first_row,lim_row,s);
+      else
+        workers.emplace_back(bound_fn,first_row,lim_row,s);
+    }
+  for (size_t w=0; w < workers.size(); w++)
+    workers[w].join();
+}
+
+#endif // THREAD_STRIPES_H
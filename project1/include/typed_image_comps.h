@@ -0,0 +1,270 @@
+/*****************************************************************************/
+// File: typed_image_comps.h
+/*****************************************************************************/
+// Image components whose samples are narrower than the 32-bit floats of
+// `my_aligned_image_comp': 8- and 16-bit unsigned integers, 16-bit signed
+// fixed-point and 16-bit (half precision) floating point.  Bandwidth-bound
+// kernels move a half or a quarter of the data when run on these, and a
+// tile of given size fits far more pixels into the cache.
+/*****************************************************************************/
+
+#ifndef TYPED_IMAGE_COMPS_H
+#define TYPED_IMAGE_COMPS_H
+
+#include <stdint.h>
+#include "aligned_image_comps.h"
+
+// Number of fractional bits in a `my_fix16' sample.  With 7, the nominal
+// range 0 to 255 of 8-bit data occupies 0 to 32640, leaving the sign bit
+// for the negative values produced by differencing filters.
+#define MY_FIX16_FRAC_BITS 7
+
+/*****************************************************************************/
+/*                              Sample types                                 */
+/*****************************************************************************/
+
+typedef uint8_t my_u8; // Nominal range 0 to 255
+typedef uint16_t my_u16; // Nominal range 0 to 255, with 8 extra LSBs
+typedef int16_t my_fix16; // Value * 2^`MY_FIX16_FRAC_BITS'
+
+struct my_f16 {
+    uint16_t bits; // IEEE 754 binary16: sign, 5 exponent bits, 10 mantissa
+  };
+  /* Notes:
+        Half precision samples are only a storage format; arithmetic on them
+     is carried out in float, as for `my_aligned_image_comp'.  Values are
+     nominally in the range 0 to 255, which binary16 represents with at
+     least 3 fractional bits. */
+
+extern float my_f16_to_float(my_f16 val);
+extern my_f16 my_float_to_f16(float val);
+  /* Exact conversion from, and round-to-nearest-even conversion to, half
+     precision.  Out-of-range values become infinities; NaNs are kept.
+     Implemented in "typed_image_comps.cpp". */
+
+/*****************************************************************************/
+/* TEMPLATE                       my_sample_traits                           */
+/*****************************************************************************/
+
+template<class T> struct my_sample_traits;
+  /* Each specialization provides:
+       `acc_type' -- the type in which kernels accumulate weighted sums of
+          samples; an integer type for the integer sample types, so that
+          their kernels never touch floating point.
+       `to_acc(x)' -- the sample's value as `acc_type'.
+       `from_acc(sum)' -- the sample which best represents `sum', rounded
+          to nearest and clamped to the range of the type.  Kernels divide
+          by the sum of their weights before calling this.
+       `to_float(x)' and `from_float(v)' -- conversion to and from the
+          nominal 0 to 255 scale of `my_aligned_image_comp', rounding to
+          nearest and clamping on the way in. */
+
+template<class T> inline T
+  my_round_clamp(float v, float lo, float hi)
+{
+  v = (v < lo)?lo:((v > hi)?hi:v);
+  return (T)((v >= 0.0F)?(v+0.5F):(v-0.5F));
+}
+
+template<class T, int MIN_VAL, int MAX_VAL> inline T
+  my_int_from_acc(int32_t sum)
+{
+  return (T)((sum < MIN_VAL)?MIN_VAL:((sum > MAX_VAL)?MAX_VAL:sum));
+}
+
+template<> struct my_sample_traits<float> {
+    typedef float acc_type;
+    static acc_type to_acc(float x) { return x; }
+    static float from_acc(acc_type sum) { return sum; }
+    static float to_float(float x) { return x; }
+    static float from_float(float v) { return v; }
+  };
+
+template<> struct my_sample_traits<my_u8> {
+    typedef int32_t acc_type;
+    static acc_type to_acc(my_u8 x) { return x; }
+    static my_u8 from_acc(acc_type sum)
+      { return my_int_from_acc<my_u8,0,255>(sum); }
+    static float to_float(my_u8 x) { return (float) x; }
+    static my_u8 from_float(float v)
+      { return my_round_clamp<my_u8>(v,0.0F,255.0F); }
+  };
+
+template<> struct my_sample_traits<my_u16> {
+    typedef int32_t acc_type;
+    static acc_type to_acc(my_u16 x) { return x; }
+    static my_u16 from_acc(acc_type sum)
+      { return my_int_from_acc<my_u16,0,65535>(sum); }
+    static float to_float(my_u16 x) { return x * (1.0F / 256.0F); }
+    static my_u16 from_float(float v)
+      { return my_round_clamp<my_u16>(v*256.0F,0.0F,65535.0F); }
+  };
+
+template<> struct my_sample_traits<my_fix16> {
+    typedef int32_t acc_type;
+    static acc_type to_acc(my_fix16 x) { return x; }
+    static my_fix16 from_acc(acc_type sum)
+      { return my_int_from_acc<my_fix16,-32768,32767>(sum); }
+    static float to_float(my_fix16 x)
+      { return x * (1.0F / (float)(1 << MY_FIX16_FRAC_BITS)); }
+    static my_fix16 from_float(float v)
+      { return my_round_clamp<my_fix16>(v*(float)(1 << MY_FIX16_FRAC_BITS),
+                                        -32768.0F,32767.0F); }
+  };
+
+template<> struct my_sample_traits<my_f16> {
+    typedef float acc_type;
+    static acc_type to_acc(my_f16 x) { return my_f16_to_float(x); }
+    static my_f16 from_acc(acc_type sum) { return my_float_to_f16(sum); }
+    static float to_float(my_f16 x) { return my_f16_to_float(x); }
+    static my_f16 from_float(float v) { return my_float_to_f16(v); }
+  };
+
+/*****************************************************************************/
+/* TEMPLATE                        my_typed_view                             */
+/*****************************************************************************/
+
+template<class T> struct my_typed_view {
+    // Data members: (these occupy space in the structure's block of memory)
+    T *buf; // Points to the first sample of the view; not owned
+    int width;
+    int height;
+    int stride; // Distance, in samples, between successive rows
+    int border; // Samples which may be read beyond each edge of the view
+    // Function members: (these do not occupy any space in memory)
+    my_typed_view()
+      { buf = NULL;  width = height = stride = border = 0; }
+    my_typed_view(T *buf, int width, int height, int stride, int border=0)
+      { this->buf = buf;  this->width = width;  this->height = height;
+        this->stride = stride;  this->border = border; }
+    T *row(int r) const
+      { return buf + ((ptrdiff_t) r)*stride; }
+    my_typed_view crop(int top, int left, int rows, int cols) const
+      {
+        assert((top >= 0) && (left >= 0) &&
+               ((top+rows) <= height) && ((left+cols) <= width));
+        my_typed_view roi(row(top)+left,cols,rows,stride,border+top);
+        int margin = border + left;
+        if (margin < roi.border) roi.border = margin;
+        margin = border + width - (left+cols);
+        if (margin < roi.border) roi.border = margin;
+        margin = border + height - (top+rows);
+        if (margin < roi.border) roi.border = margin;
+        return roi;
+      }
+  };
+  /* Notes:
+        The same as `my_image_view', for samples of type `T'.  The kernels
+     are free functions, declared below, rather than members, since each is
+     provided only for some sample types. */
+
+/*****************************************************************************/
+/* TEMPLATE                        my_typed_comp                             */
+/*****************************************************************************/
+
+template<class T> struct my_typed_comp {
+    // Data members: (these occupy space in the structure's block of memory)
+    int width;
+    int height;
+    int stride; // A multiple of `alignment'/sizeof(T) samples
+    int border; // Extra rows/cols to leave around the boundary
+    int alignment; // Bytes; every row of `buf' starts on such a boundary
+    float *handle; // Block from `plane_pool__take'
+    T *buf; // Points to the first real image sample
+    // Function members: (these do not occupy any space in memory)
+    my_typed_comp()
+      { width = height = stride = border = alignment = 0;
+        handle = NULL;  buf = NULL; }
+    my_typed_comp(my_typed_comp &&src)
+      { handle = NULL;  *this = static_cast<my_typed_comp &&>(src); }
+    my_typed_comp(const my_typed_comp &) = delete;
+    my_typed_comp &operator=(const my_typed_comp &) = delete;
+    my_typed_comp &operator=(my_typed_comp &&src)
+      {
+        if (&src == this)
+          return *this;
+        if ((handle != NULL) && (handle != src.handle))
+          plane_pool__release(handle);
+        width = src.width;  height = src.height;  stride = src.stride;
+        border = src.border;  alignment = src.alignment;
+        handle = src.handle;  buf = src.buf;
+        src.width = src.height = src.stride = src.border = 0;
+        src.handle = NULL;  src.buf = NULL;
+        return *this;
+      }
+    ~my_typed_comp()
+      { plane_pool__release(handle); }
+    void init(int height, int width, int border,
+              int alignment=MY_COMP_ALIGNMENT)
+      {
+        assert((alignment >= 16) && ((alignment & (alignment-1)) == 0));
+        this->width = width;  this->height = height;  this->border = border;
+        this->alignment = alignment;
+        int align_samples = alignment / (int) sizeof(T);
+        stride = width + 2*border;
+        stride = (stride+align_samples-1) & ~(align_samples-1);
+        int lead = (align_samples - (border & (align_samples-1))) &
+          (align_samples-1); // Places `buf' on an `alignment' boundary
+        size_t num_bytes = sizeof(T) *
+          (((size_t) lead) + ((size_t) stride)*(height+2*border));
+        plane_pool__release(handle); // Memory from any previous `init' call
+        handle = plane_pool__take((num_bytes+sizeof(float)-1)/sizeof(float),
+                                  alignment);
+        buf = ((T *) handle) + lead + (border*stride) + border;
+      }
+    my_typed_view<T> view() const
+      { return my_typed_view<T>(buf,width,height,stride,border); }
+    my_typed_view<T> crop(int top, int left, int rows, int cols) const
+      { return view().crop(top,left,rows,cols); }
+  };
+  /* Notes:
+        The same as `my_aligned_image_comp', for samples of type `T'; in
+     particular, rows are aligned in the same way and the object is
+     move-only.  The underlying memory comes from the plane pool. */
+
+/*****************************************************************************/
+/*                            Conversion helpers                             */
+/*****************************************************************************/
+
+template<class T> void
+  my_convert_samples(const my_image_view &src, const my_typed_view<T> &dst);
+  /* Converts each sample of `src' to type `T' with
+     `my_sample_traits<T>::from_float', storing the results in `dst', which
+     must be at least as large.  Border samples are not converted. */
+
+template<class T> void
+  my_convert_samples(const my_typed_view<T> &src, const my_image_view &dst);
+  /* The reverse of the above, using `my_sample_traits<T>::to_float'. */
+
+template<class T> void
+  my_perform_boundary_extension(const my_typed_view<T> &comp);
+  /* Fills the `comp.border' samples around the view by zero-order hold,
+     exactly as `my_aligned_image_comp::perform_boundary_extension' does;
+     use only on a view of a whole component. */
+
+/*****************************************************************************/
+/*                                  Kernels                                  */
+/*****************************************************************************/
+
+template<class T> void
+  my_typed_filter(const my_typed_view<T> &out, const my_typed_view<T> &in);
+  /* Same 9x9 separable box filter as `my_image_view::filter', mapping `in'
+     to `out'; `in' needs a border of at least 4.  Integer sample types
+     accumulate exactly in 32 bits and round the result once, so the output
+     is the correctly rounded mean of the 81 input samples. */
+
+template<class T> void
+  my_typed_bilinear_interpolation(const my_typed_view<T> &out,
+                                  const my_typed_view<T> &in);
+  /* Same 3x bi-linear expansion as
+     `my_image_view::bilinear_interpolation'; `out' must be at least 3
+     times as tall and as wide as `in', and `in' needs a border of at
+     least 1.  Integer weights are multiples of 1/9 and results are rounded
+     once, so integer outputs are exact to the nearest sample. */
+
+  /* Notes:
+        The functions above are implemented in "typed_image_comps.cpp" and
+     instantiated there for `my_u8', `my_u16', `my_fix16', `my_f16' and
+     float; they are not available for any other sample type. */
+
+#endif // TYPED_IMAGE_COMPS_H
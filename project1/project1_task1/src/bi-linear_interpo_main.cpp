@@ -8,9 +8,10 @@
 
 #include "io_bmp.h"
 #include "aligned_image_comps.h"
+#include "comp_io.h"
+#include "thread_stripes.h"
 #include <iostream>
 #include <chrono>
-#include <algorithm> // std::clamp
 /*****************************************************************************/
 /*                                    main                                   */
 /*****************************************************************************/
@@ -19,7 +20,7 @@ int
 {
   if (argc != 3)
     {
-      fprintf(stderr,"Usage: %s <in bmp file> <out bmp file>\n",argv[0]);
+      fprintf(stderr,"Usage: %s <in bmp/pnm/f32 file> <out bmp/pnm/f32 file>\n",argv[0]);
       return -1;
     }
 
@@ -27,80 +28,52 @@ int
   //auto start_time = std::chrono::high_resolution_clock::now();
   int err_code=0;
   try {
-      // Read the input image
-      bmp_in in;
-      if ((err_code = bmp_in__open(&in,argv[1])) != 0) // 8 bit per pixel: grey image, 24 bit per pixel: RGB image
+      // Read the input image, which may be a BMP file or a planar float
+      // file left by an earlier task.  Decoding, conversion to float and
+      // boundary extension happen in one pass, with each hardware thread
+      // taking its own stripe of rows, into a planar `my_multi_image'
+      // (see "multi_image_comps.h")
+      my_multi_image input;
+      if ((err_code = comp_io__load_multi_image(argv[1],4,MY_LAYOUT_PLANAR,
+                                                &input,default_num_threads())) != 0) // Leave a border of 4
         throw err_code;
+      int num_comps = input.num_comps;
+      int width = input.width, height = input.height;
 
-      int width = in.cols, height = in.rows;
-      int n, num_comps = in.num_components;
-      my_aligned_image_comp *input_comps =
-        new my_aligned_image_comp[num_comps];
-      for (n=0; n < num_comps; n++)
-        input_comps[n].init(height,width,4); // Leave a border of 4
-      
-      int r; // Declare row index
-      io_byte *line = new io_byte[width*num_comps];
-      for (r=height-1; r >= 0; r--)
-        { // "r" holds the true row index we are reading, since the image is
-          // stored upside down in the BMP file.
-          if ((err_code = bmp_in__get_line(&in,line)) != 0)
+      // The output is streamed to a top-down file as it is computed, so
+      // only one output row ever needs to be held in memory
+      my_aligned_image_comp *output_comps = new my_aligned_image_comp;
+      output_comps->init(1, width * 3, 0); // only need one component for grey image output
+                                           // scaling by 3, Don't need a border for output
+      bmp_out out;
+      raw_out raw;
+      comp_io_row_writer writer;
+      if (raw__file_name_matches(argv[2])) {
+          if ((err_code = raw_out__open(&raw, argv[2], width * 3, height * 3, 1)) != 0)
             throw err_code;
-          for (n=0; n < num_comps; n++)
-            {
-              io_byte *src = line+n; // Points to first sample of component n
-              float *dst = input_comps[n].buf + r * input_comps[n].stride;
-              for (int c=0; c < width; c++, src+=num_comps)
-                dst[c] = static_cast<float>(*src); // The cast to type "float" is not
-                      // strictly required here, since bytes can always be
-                      // converted to floats without any loss of information.
-            }
-        }
-      bmp_in__close(&in);
-
-      // boudary extension for input
-      for (n = 0; n < num_comps; n++) {
-          input_comps[n].perform_boundary_extension(); // symmetric extension
+          comp_io__start_raw_rows(&writer, &raw); // keeps the exact float values
+      }
+      else {
+          if ((err_code = bmp_out__open_mapped(&out, argv[2], width * 3, height * 3, 1)) != 0) 
+            throw err_code;
+          comp_io__start_rows(&writer, &out);
       }
 
-      // Allocate storage for the filtered output
-      my_aligned_image_comp *output_comps = new my_aligned_image_comp;
-      output_comps->init(height * 3, width * 3, 0); // only need one component for grey image output
-                                                    // scaling by 3, Don't need a border for output
-    
       // Process the image, all in floating point (easy)
       if (num_comps == 1) {
-          output_comps->bilinear_interpolation(input_comps); // grey image input
+          err_code = output_comps->view().bilinear_interpolation(input.comp(0), comp_io__put_row, &writer); // grey image input
       }
       else if (num_comps == 3) {
-          output_comps->bilinear_interpolation(input_comps + 1); // rgb image input
+          err_code = output_comps->view().bilinear_interpolation(input.comp(1), comp_io__put_row, &writer); // rgb image input
       }
-
-      io_byte* output_line = new io_byte[width * 3];
-      // Write the image back out again
-      bmp_out out;
-      if ((err_code = bmp_out__open(&out, argv[2], width * 3, height * 3, 1)) != 0) 
+      int flush_code = comp_io__finish_rows(&writer); // BMP output rounds and clamps to [0,255]
+      if ((err_code != 0) || ((err_code = flush_code) != 0))
         throw err_code;
-      for (r=height * 3 -1; r >= 0; r--)
-        { // "r" holds the true row index we are writing, since the image is
-          // written upside down in BMP files.
-            io_byte *dst = output_line; 
-            float *src = output_comps->buf + r * output_comps->stride;
-            for (int c = 0; c < width * 3; c++, dst++) {
-                *dst = static_cast<io_byte>(std::clamp(src[c] + 0.5F, 0.0F, 255.0F)); // The cast to type "io_byte" is
-                // required here, since floats cannot generally be
-                // converted to bytes without loss of information.  The
-                // compiler will warn you of this if you remove the cast.
-                // There is in fact not the best way to do the
-                // conversion.  You should fix it up in the lab. -- done
-            }
-          bmp_out__put_line(&out,output_line);
-        }
-      bmp_out__close(&out);
-      delete[] line;
-      delete[] input_comps;
+      if (writer.raw != NULL)
+        raw_out__close(&raw);
+      else
+        bmp_out__close(&out);
       delete output_comps;
-      delete[] output_line;
     }
   catch (int exc) {
       if (exc == IO_ERR_NO_FILE)
@@ -8,9 +8,10 @@
 
 #include "io_bmp.h"
 #include "aligned_image_comps.h"
+#include "comp_io.h"
+#include "thread_stripes.h"
 #include <iostream>
 #include <chrono>
-#include <algorithm> // std::clamp
 /*****************************************************************************/
 /*                                    main                                   */
 /*****************************************************************************/
@@ -19,7 +20,7 @@ int
 {
   if (argc != 5)
     {
-      fprintf(stderr,"Usage: %s <in bmp file> <out bmp file> <s> <on/off>\n",argv[0]); // ! 's' means sigma in Gussian Filter, also AKA "Scale Parameter"
+      fprintf(stderr,"Usage: %s <in bmp/pnm/f32 file> <out bmp/pnm/f32 file> <s> <on/off>\n",argv[0]); // ! 's' means sigma in Gussian Filter, also AKA "Scale Parameter"
       return -1;
     }
 
@@ -27,48 +28,23 @@ int
   if (s < 1 || s > 5) {
       fprintf(stderr, "s must be in the range of 1 to 5\n");
   }
-  int s0 = static_cast<int>(s + 1.0F);
-  int border = 3 * s0;
 
   //// begin timer
   //auto start_time = std::chrono::high_resolution_clock::now();
   int err_code=0;
   try {
-      // Read the input image
-      bmp_in in;
-      if ((err_code = bmp_in__open(&in,argv[1])) != 0) // 8 bit per pixel: grey image, 24 bit per pixel: RGB image
+      // Read the input image, which may be a BMP file or a planar float
+      // file left by an earlier task.  Decoding, conversion to float and
+      // boundary extension happen in one pass, with each hardware thread
+      // taking its own stripe of rows, into a planar `my_multi_image'
+      // (see "multi_image_comps.h").  No border is needed: the filter
+      // extends the image edges virtually, by zero-order hold
+      my_multi_image input;
+      if ((err_code = comp_io__load_multi_image(argv[1],0,MY_LAYOUT_PLANAR,
+                                                &input,default_num_threads())) != 0)
         throw err_code;
-
-      int width = in.cols, height = in.rows;
-      int n, num_comps = in.num_components;
-      my_aligned_image_comp *input_comps =
-        new my_aligned_image_comp[num_comps];
-      for (n=0; n < num_comps; n++)
-        input_comps[n].init(height,width,border); // Leave a border of 4
-      
-      int r; // Declare row index
-      io_byte *line = new io_byte[width*num_comps];
-      for (r=height-1; r >= 0; r--)
-        { // "r" holds the true row index we are reading, since the image is
-          // stored upside down in the BMP file.
-          if ((err_code = bmp_in__get_line(&in,line)) != 0)
-            throw err_code;
-          for (n=0; n < num_comps; n++)
-            {
-              io_byte *src = line+n; // Points to first sample of component n
-              float *dst = input_comps[n].buf + r * input_comps[n].stride;
-              for (int c=0; c < width; c++, src+=num_comps)
-                dst[c] = static_cast<float>(*src); // The cast to type "float" is not
-                      // strictly required here, since bytes can always be
-                      // converted to floats without any loss of information.
-            }
-        }
-      bmp_in__close(&in);
-
-      // boudary extension for input
-      for (n = 0; n < num_comps; n++) {
-          input_comps[n].perform_boundary_extension();
-      }
+      int num_comps = input.num_comps;
+      int width = input.width, height = input.height;
 
       // Allocate storage for the filtered output
       my_aligned_image_comp *output_comps = new my_aligned_image_comp;
@@ -78,33 +54,20 @@ int
       float* rgb_buf = nullptr;
       // Process the image, all in floating point (easy)
       if (num_comps == 1) {
-          rgb_buf = output_comps->derivative_gaussian(input_comps, s, argv[4]); // grey image input
+          rgb_buf = output_comps->view().derivative_gaussian(input.comp(0), s, argv[4],
+                                                          BoundaryExtensionType::zero_order_hold); // grey image input
       }
       else if (num_comps == 3) {
-          rgb_buf = output_comps->derivative_gaussian(input_comps + 1, s, argv[4]); // rgb image input
+          rgb_buf = output_comps->view().derivative_gaussian(input.comp(1), s, argv[4],
+                                                          BoundaryExtensionType::zero_order_hold); // rgb image input
       }
 
-      io_byte* output_line = new io_byte[width * 3];
       // Write the image back out again
-      bmp_out out;
-      if ((err_code = bmp_out__open(&out, argv[2], width, height, 3)) != 0) 
+      if ((err_code = comp_io__save_interleaved(argv[2], rgb_buf, width, height, 3,
+                                                default_num_threads())) != 0) // BMP output rounds and clamps to [0,255]
         throw err_code;
-      for (r=height - 1; r >= 0; r--)
-        { // "r" holds the true row index we are writing, since the image is
-          // written upside down in BMP files.
-          io_byte* dst = output_line;
-          float* src = rgb_buf + r * width * 3;
-          for (int c = 0; c < width * 3; c++) {
-              dst[c] = static_cast<io_byte>(std::clamp(src[c] + 0.5F, 0.0F, 255.0F));
-          }
-          bmp_out__put_line(&out, output_line);
-        }
-      bmp_out__close(&out);
-      delete[] line;
-      delete[] input_comps;
       delete output_comps;
-      delete[] output_line;
-      delete rgb_buf;
+      plane_pool__release(rgb_buf);
     }
   catch (int exc) {
       if (exc == IO_ERR_NO_FILE)
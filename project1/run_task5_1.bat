@@ -1,6 +1,6 @@
 cd .\data
-..\bin\project1_task1.exe pens_rgb.bmp out1.bmp
-..\bin\project1_task3_n_task4.exe out1.bmp bi-linear_out.bmp 10 off
+..\bin\project1_task1.exe pens_rgb.bmp out1.f32
+..\bin\project1_task3_n_task4.exe out1.f32 bi-linear_out.bmp 10 off
 
 start  mi_viewer bi-linear_out.bmp
 
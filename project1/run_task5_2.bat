@@ -1,6 +1,6 @@
 cd .\data
-..\bin\project1_task2.exe pens_rgb.bmp out1.bmp 2
-..\bin\project1_task3_n_task4.exe out1.bmp sinc_out.bmp 10 off
+..\bin\project1_task2.exe pens_rgb.bmp out1.f32 2
+..\bin\project1_task3_n_task4.exe out1.f32 sinc_out.bmp 10 off
 
 start  mi_viewer sinc_out.bmp
 
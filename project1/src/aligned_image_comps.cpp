@@ -1,49 +1,294 @@
 ﻿#include "aligned_image_comps.h"
+#include "thread_stripes.h"
+#include "simd_filter.h"
 #include <iostream>
 #include <emmintrin.h>
 #include <cmath>
 #include <algorithm>
+#include <new>
+#include <vector>
+#include <stdlib.h>
+#include <string.h>
+#ifdef _WIN32
+#  include <malloc.h>
+#endif
+
+/*****************************************************************************/
+/*                              my_aligned_alloc                             */
+/*****************************************************************************/
+float* my_aligned_alloc(size_t num_floats, int alignment)
+{
+    size_t num_bytes = num_floats * sizeof(float);
+    if (num_bytes == 0)
+        num_bytes = alignment; // Keep the result distinct from NULL
+#ifdef _WIN32
+    void* block = _aligned_malloc(num_bytes, (size_t)alignment);
+#else
+    void* block = NULL;
+    if (posix_memalign(&block, (size_t)alignment, num_bytes) != 0)
+        block = NULL;
+#endif
+    if (block == NULL)
+        throw std::bad_alloc();
+    return (float*)block;
+}
+
+/*****************************************************************************/
+/*                              my_aligned_free                              */
+/*****************************************************************************/
+void my_aligned_free(float* block)
+{
+#ifdef _WIN32
+    _aligned_free(block);
+#else
+    free(block);
+#endif
+}
+
 /* ========================================================================= */
 /*                 Implementation of `my_image_comp' functions               */
 /* ========================================================================= */
 
 /*****************************************************************************/
-/*              my_aligned_image_comp::perform_boundary_extension            */
+/*                 my_image_view::perform_boundary_extension                 */
 /*****************************************************************************/
 constexpr float pi = 3.1415926F;
 
-void my_aligned_image_comp::perform_boundary_extension()
+// Index, within a line of `len' samples, of the sample mirrored into
+// position `n' by the symmetric modes; reflects as often as necessary
+static inline int reflect_index(int n, int len)
 {
-    int r, c;
-
-    // First extend upwards
-    float* first_line = buf;
-    for (r = 1; r <= border; r++)
-        for (c = 0; c < width; c++)
-            first_line[-r * stride + c] = first_line[c];
-
-    // Now extend downwards
-    float* last_line = buf + (height - 1) * stride;
-    for (r = 1; r <= border; r++)
-        for (c = 0; c < width; c++)
-            last_line[r * stride + c] = last_line[c];
-
-    // Now extend all rows to the left and to the right
-    float* left_edge = buf - border * stride;
-    float* right_edge = left_edge + width - 1;
-    for (r = height + 2 * border; r > 0; r--, left_edge += stride, right_edge += stride)
-        for (c = 1; c <= border; c++)
-        {
-            left_edge[-c] = left_edge[0];
-            right_edge[c] = right_edge[0];
+    if (len == 1)
+        return 0;
+    int period = 2 * (len - 1);
+    n %= period;
+    if (n < 0)
+        n += period;
+    return (n < len) ? n : (period - n);
+}
+
+// Reverses the order of the 4 samples in `v'
+static inline __m128 reverse_ps(__m128 v)
+{
+    return _mm_shuffle_ps(v, v, _MM_SHUFFLE(0, 1, 2, 3));
+}
+
+// Fills the `border' samples to either side of one row of `width' samples
+static void extend_row(float* row, int width, int border,
+                       BoundaryExtensionType type)
+{
+    float* right_edge = row + width - 1;
+    int c = 1; // Each iteration writes row[-c-3..-c] and right_edge[c..c+3]
+    if ((type == BoundaryExtensionType::zero_padding) ||
+        (type == BoundaryExtensionType::zero_order_hold))
+    {
+        bool zero = (type == BoundaryExtensionType::zero_padding);
+        __m128 left = zero ? _mm_setzero_ps() : _mm_set1_ps(row[0]);
+        __m128 right = zero ? _mm_setzero_ps() : _mm_set1_ps(*right_edge);
+        for (; (c + 3) <= border; c += 4) {
+            _mm_storeu_ps(row - c - 3, left);
+            _mm_storeu_ps(right_edge + c, right);
+        }
+        for (; c <= border; c++) {
+            row[-c] = _mm_cvtss_f32(left);
+            right_edge[c] = _mm_cvtss_f32(right);
         }
+        return;
+    }
+
+    bool point = (type == BoundaryExtensionType::point_symmetric_extension);
+    float left_val = row[0], right_val = *right_edge;
+    if (border < width)
+    { // Mirror images all lie within the row, so move 4 at a time
+        __m128 twice_left = _mm_set1_ps(2.0F * left_val);
+        __m128 twice_right = _mm_set1_ps(2.0F * right_val);
+        for (; (c + 3) <= border; c += 4) {
+            __m128 left = reverse_ps(_mm_loadu_ps(row + c));
+            __m128 right = reverse_ps(_mm_loadu_ps(right_edge - c - 3));
+            if (point) {
+                left = _mm_sub_ps(twice_left, left);
+                right = _mm_sub_ps(twice_right, right);
+            }
+            _mm_storeu_ps(row - c - 3, left);
+            _mm_storeu_ps(right_edge + c, right);
+        }
+    }
+    for (; c <= border; c++) {
+        float left = row[reflect_index(-c, width)];
+        float right = row[reflect_index(width - 1 + c, width)];
+        row[-c] = point ? (2.0F * left_val - left) : left;
+        right_edge[c] = point ? (2.0F * right_val - right) : right;
+    }
+}
+
+// Writes one whole border row of `len' samples, border columns included
+static void extend_border_row(float* dst, const float* src, const float* edge,
+                              int len, BoundaryExtensionType type)
+{
+    if (type == BoundaryExtensionType::zero_padding)
+        memset(dst, 0, sizeof(float) * (size_t)len);
+    else if (type != BoundaryExtensionType::point_symmetric_extension)
+        memcpy(dst, src, sizeof(float) * (size_t)len);
+    else {
+        __m128 two = _mm_set1_ps(2.0F);
+        int c = 0;
+        for (; c <= (len - 4); c += 4) {
+            __m128 val = _mm_mul_ps(two, _mm_loadu_ps(edge + c));
+            _mm_storeu_ps(dst + c, _mm_sub_ps(val, _mm_loadu_ps(src + c)));
+        }
+        for (; c < len; c++)
+            dst[c] = 2.0F * edge[c] - src[c];
+    }
+}
+
+void my_image_view::extend_row_edges(BoundaryExtensionType type, int r)
+{
+    extend_row(row(r), width, border, type);
+}
+
+void my_image_view::fill_border_row(BoundaryExtensionType type, int k)
+{
+    int r = (k < border) ? -(k + 1) : (height + k - border);
+    int edge = (k < border) ? 0 : (height - 1);
+    int src = edge;
+    if ((type == BoundaryExtensionType::symmetric_extension) ||
+        (type == BoundaryExtensionType::point_symmetric_extension))
+        src = reflect_index(r, height);
+    extend_border_row(row(r) - border, row(src) - border, row(edge) - border,
+                      width + 2 * border, type);
+}
+
+void my_image_view::perform_boundary_extension(BoundaryExtensionType type,
+                                               int num_threads)
+{
+    if (border <= 0)
+        return;
+
+    // First extend every real row to the left and to the right
+    run_stripes(height, num_threads, [&](int first_row, int lim_row, int /*s*/) {
+        for (int r = first_row; r < lim_row; r++)
+            extend_row_edges(type, r);
+    });
+
+    // Now fill the border rows above and below from the extended rows
+    run_stripes(2 * border, num_threads, [&](int first, int lim, int /*s*/) {
+        for (int k = first; k < lim; k++)
+            fill_border_row(type, k);
+    });
+}
+
+/*****************************************************************************/
+/*                     my_aligned_image_comp::first_touch                    */
+/*****************************************************************************/
+
+void my_aligned_image_comp::first_touch(int num_threads)
+{
+    size_t row_bytes = sizeof(float) * (size_t)stride;
+    float* first_sample = buf - border; // Start of row 0, border included
+    run_stripes(height, num_threads, [&](int first_row, int lim_row, int /*s*/) {
+        if (first_row == 0)
+            first_row = -border; // First stripe takes the top border rows
+        if (lim_row == height)
+            lim_row = height + border; // Last stripe takes the bottom ones
+        memset(first_sample + first_row * stride, 0,
+               row_bytes * (size_t)(lim_row - first_row));
+    });
+}
+
+/*****************************************************************************/
+/*                         Virtual boundary handling                         */
+/*****************************************************************************/
+
+// Index-remap table for one direction of a border-free kernel: records
+// which real sample of a line of `len' samples stands in for each of the
+// `extent' virtual samples beyond either end, under extension `type'
+struct boundary_remap {
+    BoundaryExtensionType type;
+    int len;
+    int extent;
+    std::vector<int> before; // Sources for positions -extent .. -1; -1 = 0
+    std::vector<int> after; // Sources for positions len .. len+extent-1
+    boundary_remap(BoundaryExtensionType type, int len, int extent)
+        : before(extent), after(extent)
+    {
+        this->type = type;  this->len = len;  this->extent = extent;
+        for (int k = 0; k < extent; k++) {
+            int n = k - extent, m = len + k;
+            if (type == BoundaryExtensionType::zero_padding)
+                before[k] = after[k] = -1;
+            else if (type == BoundaryExtensionType::zero_order_hold)
+                { before[k] = 0;  after[k] = len - 1; }
+            else
+                { before[k] = reflect_index(n, len);
+                  after[k] = reflect_index(m, len); }
+        }
+    }
+    int index(int n) const
+    { // Source of position `n', which lies outside the line; -1 means zero
+        assert((n >= -extent) && (n < len + extent));
+        return (n < 0) ? before[n + extent] : after[n - len];
+    }
+    float sample(const float* line, int n) const
+    { // Value at position `n', which may lie inside or outside the line
+        if ((n >= 0) && (n < len))
+            return line[n];
+        int i = index(n);
+        if (i < 0)
+            return 0.0F;
+        if (type != BoundaryExtensionType::point_symmetric_extension)
+            return line[i];
+        return 2.0F * line[(n < 0) ? 0 : (len - 1)] - line[i];
+    }
+    const float* row(const my_image_view& in, int n, const float** edge) const
+    { // Row of `in' standing in for row `n' (NULL if zero), and the edge row
+      // it is reflected through under point-symmetric extension (else NULL)
+        *edge = NULL;
+        if ((n >= 0) && (n < len))
+            return in.row(n);
+        int i = index(n);
+        if (i < 0)
+            return NULL;
+        if (type == BoundaryExtensionType::point_symmetric_extension)
+            *edge = in.row((n < 0) ? 0 : (len - 1));
+        return in.row(i);
+    }
+};
+
+// Fills `src' and `edge' with the input rows read by the vertical taps
+// -`extent' to `extent' about row `r' (see `boundary_remap::row'); with no
+// remap table these are simply the rows above and below, border included.
+// Returns false if any row is virtual, so that the caller must check them.
+static bool gather_rows(const my_image_view& in, const boundary_remap* rows,
+                        int r, int extent, const float** src,
+                        const float** edge)
+{
+    bool direct = (rows == NULL) ||
+        ((r >= extent) && ((r + extent) < in.height));
+    for (int y = -extent; y <= extent; y++) {
+        if (direct)
+            { src[y + extent] = in.row(r + y);  edge[y + extent] = NULL; }
+        else
+            src[y + extent] = rows->row(in, r + y, edge + y + extent);
+    }
+    return direct;
+}
+
+// Virtual-edge vertical tap: sample `c' of the row stood in for by `src'
+static inline float virtual_tap(const float* src, const float* edge, int c)
+{
+    if (src == NULL)
+        return 0.0F;
+    return (edge == NULL) ? src[c] : (2.0F * edge[c] - src[c]);
 }
 
 /*****************************************************************************/
-/*                        my_aligned_image_comp::filter                      */
+/*                           my_image_view::filter                           */
 /*****************************************************************************/
 
-void my_aligned_image_comp::filter(my_aligned_image_comp* in)
+// Shared by both forms of `my_image_view::filter'; `rows' and `cols' are
+// NULL when `in' has a real border to read from
+static void filter_rows(const my_image_view& out, const my_image_view& in,
+                        const boundary_remap* rows, const boundary_remap* cols)
 {
     const int FILTER_EXTENT = 4;
     const int FILTER_TAPS = (2 * FILTER_EXTENT + 1);
@@ -56,23 +301,45 @@ void my_aligned_image_comp::filter(my_aligned_image_comp* in)
         mirror_psf[t] = 1.0F / FILTER_TAPS;
 
     // Check for consistent dimensions
-    assert(in->border >= FILTER_EXTENT);
-    assert((this->height <= in->height) && (this->width <= in->width));
-
-    // Allocate line buffers
-    float* line_buffer = new float[width];        // Store vertical result for 1 row
-    float* line_buffer2 = new float[width];       // Store horizontal result
+    assert((rows != NULL) || (in.border >= FILTER_EXTENT));
+    assert((out.height <= in.height) && (out.width <= in.width));
+
+    // Allocate line buffers.  The vertical result is kept for the
+    // `FILTER_EXTENT' columns to either side of the output as well, which
+    // the horizontal pass reads; without a real border these come from
+    // the column remap table
+    int width = out.width;
+    float* line_handle = plane_pool__take(width + 2 * FILTER_EXTENT, MY_COMP_ALIGNMENT);
+    float* line_buffer = line_handle + FILTER_EXTENT; // Store vertical result for 1 row
+    float* line_buffer2 = plane_pool__take(width, MY_COMP_ALIGNMENT); // Store horizontal result
+    int first_col = -FILTER_EXTENT, lim_col = width + FILTER_EXTENT;
+    if (cols != NULL)
+        { first_col = 0;  lim_col = std::min(lim_col, in.width); }
 
     // Combined vertical + horizontal convolution row-by-row
-    for (int r = 0; r < height; ++r) {
+    const float* src[FILTER_TAPS];
+    const float* edge[FILTER_TAPS];
+    for (int r = 0; r < out.height; ++r) {
         // 1. Perform vertical convolution for this row
-        for (int c = 0; c < width; ++c) {
-            float sum = 0.0F;
-            for (int y = -FILTER_EXTENT; y <= FILTER_EXTENT; ++y) {
-                float* ip = in->buf + (r + y) * in->stride + c;
-                sum += (*ip) * mirror_psf[y];
+        if (gather_rows(in, rows, r, FILTER_EXTENT, src, edge))
+            for (int c = first_col; c < lim_col; ++c) {
+                float sum = 0.0F;
+                for (int y = -FILTER_EXTENT; y <= FILTER_EXTENT; ++y)
+                    sum += src[y + FILTER_EXTENT][c] * mirror_psf[y];
+                line_buffer[c] = sum;  // store vertically filtered value
+            }
+        else
+            for (int c = first_col; c < lim_col; ++c) {
+                float sum = 0.0F;
+                for (int y = -FILTER_EXTENT; y <= FILTER_EXTENT; ++y)
+                    sum += virtual_tap(src[y + FILTER_EXTENT], edge[y + FILTER_EXTENT], c) * mirror_psf[y];
+                line_buffer[c] = sum;
             }
-            line_buffer[c] = sum;  // store vertically filtered value
+        if (cols != NULL) { // Extend the vertical result by remapping
+            for (int c = -FILTER_EXTENT; c < first_col; ++c)
+                line_buffer[c] = cols->sample(line_buffer, c);
+            for (int c = lim_col; c < width + FILTER_EXTENT; ++c)
+                line_buffer[c] = cols->sample(line_buffer, c);
         }
 
         // 2. Perform horizontal convolution on this line
@@ -85,15 +352,35 @@ void my_aligned_image_comp::filter(my_aligned_image_comp* in)
         }
 
         // 3. Write final result to output image
+        float* line_out = out.row(r);
         for (int c = 0; c < width; ++c) {
-            buf[r * stride + c] = line_buffer2[c];
+            line_out[c] = line_buffer2[c];
         }
     }
-    delete[] line_buffer;
-    delete[] line_buffer2;
+    plane_pool__release(line_handle);
+    plane_pool__release(line_buffer2);
 }
 
-void my_aligned_image_comp::vector_filter(my_aligned_image_comp* in)
+void my_image_view::filter(const my_image_view &in)
+{
+    filter_rows(*this, in, NULL, NULL);
+}
+
+void my_image_view::filter(const my_image_view &in, BoundaryExtensionType ext)
+{
+    boundary_remap rows(ext, in.height, 4), cols(ext, in.width, 4);
+    filter_rows(*this, in, &rows, &cols);
+}
+
+/*****************************************************************************/
+/*                        my_image_view::vector_filter                       */
+/*****************************************************************************/
+
+// Shared by both forms of `my_image_view::vector_filter'; `rows' is NULL
+// when `in' has a real border to read from
+static void vector_filter_rows(const my_image_view& out,
+                               const my_image_view& in,
+                               const boundary_remap* rows)
 {
     const int FILTER_EXTENT = 4;
     const int FILTER_TAPS = (2 * FILTER_EXTENT + 1);
@@ -102,83 +389,215 @@ void my_aligned_image_comp::vector_filter(my_aligned_image_comp* in)
     __m128 filter_buf[FILTER_TAPS];
     __m128* mirror_psf = filter_buf + FILTER_EXTENT;
     // `mirror_psf' points to the central tap in the filter
-    for (int t = -FILTER_EXTENT; t <= FILTER_EXTENT; t++)
+    float taps[FILTER_TAPS];
+    for (int t = -FILTER_EXTENT; t <= FILTER_EXTENT; t++) {
         mirror_psf[t] = _mm_set1_ps(1.0F / FILTER_TAPS);
+        taps[t + FILTER_EXTENT] = 1.0F / FILTER_TAPS;
+    }
 
     // Check for consistent dimensions
-    assert(in->border >= FILTER_EXTENT);
-    assert((this->height <= in->height) && (this->width <= in->width));
-    assert(((stride & 3) == 0) && ((in->stride & 3) == 0));
-    int vec_stride_in = in->stride / 4;
-    int vec_stride_out = this->stride / 4;
-    int vec_width_out = (this->width + 3) / 4; // Big enough to cover the width
-
-    // Do the filtering
-    __m128* line_out = (__m128*) buf;
-    __m128* line_in = (__m128*)(in->buf);
-    for (int r = 0; r < height; r++,
-        line_out += vec_stride_out, line_in += vec_stride_in)
-        for (int c = 0; c < vec_width_out; c++)
-        {
-            __m128* ip = (line_in + c) - vec_stride_in * FILTER_EXTENT;
+    assert((rows != NULL) || (in.border >= FILTER_EXTENT));
+    assert((out.height <= in.height) && (out.width <= in.width));
+    int width = out.width;
+    int vec_width_out = width & ~3; // Whole vectors only; see below
+
+    // Do the filtering.  Views cropped from the middle of a row need not
+    // start on a 16-byte boundary, so unaligned loads and stores are used;
+    // these cost nothing extra when the addresses happen to be aligned.
+    const float* src[FILTER_TAPS];
+    const float* edge[FILTER_TAPS];
+    for (int r = 0; r < out.height; r++)
+    {
+        float* line_out = out.row(r);
+        int c = 0;
+        if (gather_rows(in, rows, r, FILTER_EXTENT, src, edge))
+        { // Every tap reads a real row: no checks needed, so use the
+          // widest vectors the processor has (see "simd_filter.h")
+            simd_filter__vertical(line_out, src, taps, FILTER_TAPS, width);
+            continue;
+        }
+        for (; c < vec_width_out; c += 4)
+        { // Top or bottom rows: some taps are zero or point-reflected
             __m128 sum = _mm_setzero_ps();
-            for (int y = -FILTER_EXTENT; y <= FILTER_EXTENT; y++, ip += vec_stride_in)
-                sum = _mm_add_ps(sum, _mm_mul_ps(mirror_psf[y], *ip));
+            for (int t = 0; t < FILTER_TAPS; t++)
+            {
+                if (src[t] == NULL)
+                    continue;
+                __m128 val = _mm_loadu_ps(src[t] + c);
+                if (edge[t] != NULL)
+                    val = _mm_sub_ps(_mm_add_ps(_mm_loadu_ps(edge[t] + c),
+                                                _mm_loadu_ps(edge[t] + c)), val);
+                sum = _mm_add_ps(sum, _mm_mul_ps(filter_buf[t], val));
+            }
+            _mm_storeu_ps(line_out + c, sum);
+        }
+        for (; c < width; c++)
+        {
+            float sum = 0.0F;
+            for (int t = 0; t < FILTER_TAPS; t++)
+                sum += (1.0F / FILTER_TAPS) * virtual_tap(src[t], edge[t], c);
             line_out[c] = sum;
         }
+    }
+}
+
+void my_image_view::vector_filter(const my_image_view &in)
+{
+    vector_filter_rows(*this, in, NULL);
+}
+
+void my_image_view::vector_filter(const my_image_view &in,
+                                  BoundaryExtensionType ext)
+{
+    boundary_remap rows(ext, in.height, 4);
+    vector_filter_rows(*this, in, &rows);
 }
 
 /*****************************************************************************/
-/*                  my_aligned_image_comp::bilinear_interpolation            */
+/*                       my_image_view::vector_filter_2d                     */
 /*****************************************************************************/
-void my_aligned_image_comp::bilinear_interpolation(my_aligned_image_comp* in) {
+
+// Shared by both forms of `my_image_view::vector_filter_2d'; `rows' and
+// `cols' are NULL when `in' has a real border to read from
+static void vector_filter_2d_rows(const my_image_view& out,
+                                  const my_image_view& in,
+                                  const boundary_remap* rows,
+                                  const boundary_remap* cols)
+{
+    const int FILTER_EXTENT = 4;
+    const int FILTER_TAPS = (2 * FILTER_EXTENT + 1);
+
+    float taps[FILTER_TAPS];
+    for (int t = 0; t < FILTER_TAPS; t++)
+        taps[t] = 1.0F / FILTER_TAPS;
+
+    // Check for consistent dimensions
+    assert((rows != NULL) || (in.border >= FILTER_EXTENT));
+    assert((out.height <= in.height) && (out.width <= in.width));
+
+    // The line buffer holds the vertical result for the `FILTER_EXTENT'
+    // columns to either side of the output too, as in `filter'.  Its first
+    // output sample is 16-byte aligned, as are the handles from the plane
+    // pool, so the horizontal pass can use aligned loads; a spare vector at
+    // the end keeps whole-block reads within the buffer.
+    int width = out.width;
+    float* line_handle = plane_pool__take(width + 2 * FILTER_EXTENT + 4, MY_COMP_ALIGNMENT);
+    float* line_buffer = line_handle + FILTER_EXTENT;
+    int first_col = -FILTER_EXTENT, lim_col = width + FILTER_EXTENT;
+    if (cols != NULL)
+        { first_col = 0;  lim_col = std::min(lim_col, in.width); }
+
+    const float* src[FILTER_TAPS];
+    const float* edge[FILTER_TAPS];
+    for (int r = 0; r < out.height; r++)
+    {
+        // 1. Vertical pass into the line buffer
+        if (gather_rows(in, rows, r, FILTER_EXTENT, src, edge))
+        {
+            for (int t = 0; t < FILTER_TAPS; t++)
+                src[t] += first_col;
+            simd_filter__vertical(line_buffer + first_col, src, taps,
+                                  FILTER_TAPS, lim_col - first_col);
+        }
+        else
+            for (int c = first_col; c < lim_col; c++)
+            { // Top or bottom rows: some taps are zero or point-reflected
+                float sum = 0.0F;
+                for (int t = 0; t < FILTER_TAPS; t++)
+                    sum += taps[t] * virtual_tap(src[t], edge[t], c);
+                line_buffer[c] = sum;
+            }
+        if (cols != NULL)
+        { // Extend the vertical result by remapping
+            for (int c = -FILTER_EXTENT; c < first_col; c++)
+                line_buffer[c] = cols->sample(line_buffer, c);
+            for (int c = lim_col; c < width + FILTER_EXTENT; c++)
+                line_buffer[c] = cols->sample(line_buffer, c);
+        }
+
+        // 2. Horizontal pass straight into the output row
+        simd_filter__horizontal(out.row(r), line_buffer,
+                                taps + FILTER_EXTENT, FILTER_EXTENT, width);
+    }
+    plane_pool__release(line_handle);
+}
+
+void my_image_view::vector_filter_2d(const my_image_view &in)
+{
+    vector_filter_2d_rows(*this, in, NULL, NULL);
+}
+
+void my_image_view::vector_filter_2d(const my_image_view &in,
+                                     BoundaryExtensionType ext)
+{
+    boundary_remap rows(ext, in.height, 4), cols(ext, in.width, 4);
+    vector_filter_2d_rows(*this, in, &rows, &cols);
+}
+
+/*****************************************************************************/
+/*                   my_image_view::bilinear_interpolation                   */
+/*****************************************************************************/
+// computes output row `y' of the 3x bi-linear expansion of `in' into `op'
+static void bilinear_row(const my_image_view &in, int y, float* op) {
     // define scaling factor
     const int scale = 3;
 
-    float* ip = in->buf;
-    float* op = buf;
+    const float* ip = in.buf;
+    int input_stride = in.stride;
+    int output_width = in.width * 3;
 
-    int input_stride = in->stride;
-    int output_stride = stride;
-    int output_height = in->height * 3;
-    int output_width = in->width * 3;
+    float input_y = static_cast<float>(y) / scale; // scale promoted to float implicitly
+    int n2 = static_cast<int>(input_y); // vertical index
+    float sigma_2 = input_y - n2;
 
+    for (int x = 0; x < output_width; x++) {
+        float input_x = static_cast<float>(x) / scale;
+        int n1 = static_cast<int>(input_x); // horizontal index
+        float sigma_1 = input_x - n1;
+
+        // find 4 nearby pixel values; the last input row/column pairs up
+        // with the border, which must therefore be at least 1 sample wide
+        float top_left = ip[n2 * input_stride + n1];
+        float top_right = ip[n2 * input_stride + (n1 + 1)];
+        float bottom_left = ip[(n2 + 1) * input_stride + n1];
+        float bottom_right = ip[(n2 + 1) * input_stride + (n1 + 1)];
+
+        // do bilinear calculation
+        float interpolated =
+            (1 - sigma_2) * ((1 - sigma_1) * top_left + sigma_1 * top_right) +
+            sigma_2 * ((1 - sigma_1) * bottom_left + sigma_1 * bottom_right);
+
+        op[x] = interpolated;
+    }
+}
+
+void my_image_view::bilinear_interpolation(const my_image_view &in) {
+    assert(in.border >= 1);
+    int output_height = in.height * 3;
     for (int y = 0; y < output_height; y++) {
-        int y0 = y;
-        if (y < output_height - 2) { y = output_height - 2; }
-        float input_y = static_cast<float>(y) / scale; // scale promoted to float implicitly
-        int n2 = static_cast<int>(input_y); // vertical index
-        float sigma_2 = input_y - n2;
-
-        for (int x = 0; x < output_width; x++) {
-            int x0 = x;
-            if (x < output_width - 2) { x = output_width - 2; }
-            float input_x = static_cast<float>(x) / scale;
-            int n1 = static_cast<int>(input_x); // horizontal index
-            float sigma_1 = input_x - n1;
-
-            // find 4 nearby pixel values
-            float top_left = ip[n2 * input_stride + n1];
-            float top_right = ip[n2 * input_stride + (n1 + 1)];
-            float bottom_left = ip[(n2 + 1) * input_stride + n1];
-            float bottom_right = ip[(n2 + 1) * input_stride + (n1 + 1)];
-
-            // do bilinear calculation
-            float interpolated =
-                (1 - sigma_2) * ((1 - sigma_1) * top_left + sigma_1 * top_right) +
-                sigma_2 * ((1 - sigma_1) * bottom_left + sigma_1 * bottom_right);
-
-            op[y * output_stride + x] = interpolated;
-            x = x0;
+        bilinear_row(in, y, buf + y * stride);
+    }
+    std::cout << "bilinear interpolation done\n";
+}
+
+int my_image_view::bilinear_interpolation(const my_image_view &in, my_row_sink sink, void* context) {
+    assert(in.border >= 1);
+    assert(width >= in.width * 3);
+    int output_height = in.height * 3;
+    for (int y = 0; y < output_height; y++) {
+        bilinear_row(in, y, buf); // Reuse our first row for every output row
+        int err_code = sink(context, buf, in.width * 3);
+        if (err_code != 0) {
+            return err_code;
         }
-        y = y0;
     }
     std::cout << "bilinear interpolation done\n";
+    return 0;
 }
 
 
 /*****************************************************************************/
-/*                  my_aligned_image_comp::sinc_interpolation                */
+/*                     my_image_view::sinc_interpolation                     */
 /*****************************************************************************/
 // define hann_sinc function and then use it for every pixel
 inline float hann_sinc(float x, int H) {
@@ -189,25 +608,25 @@ inline float hann_sinc(float x, int H) {
 
 // definition of sinc interpolation
 // using raised cosine
-void my_aligned_image_comp::sinc_interpolation(my_aligned_image_comp* in, int H) {
+void my_image_view::sinc_interpolation(const my_image_view &in, int H) {
     // define scaling factor
     const int scale = 3;
 
     const int FILTER_EXTENT = H;
     const int FILTER_TAPS = 2 * FILTER_EXTENT + 1;
-    float* ip = in->buf;
+    float* ip = in.buf;
     float* op = buf;
-    int input_stride = in->stride;
+    int input_stride = in.stride;
     int output_stride = stride;
-    int output_height = in->height * scale;
-    int output_width = in->width * scale;
+    int output_height = in.height * scale;
+    int output_width = in.width * scale;
 
     // Check for consistent dimensions
-    assert(in->border >= FILTER_EXTENT);
+    assert(in.border >= FILTER_EXTENT);
 
     // store intermediate results
-    float* line_buffer = new float[output_width];
-    float* line_buffer2 = new float[output_width];
+    float* line_buffer = plane_pool__take(output_width, MY_COMP_ALIGNMENT);
+    float* line_buffer2 = plane_pool__take(output_width, MY_COMP_ALIGNMENT);
 
     // 1. Perform the vertical convolution
     // (u , v) represents the inverse mapped coordinates from the scaled image
@@ -270,15 +689,15 @@ void my_aligned_image_comp::sinc_interpolation(my_aligned_image_comp* in, int H)
         }
     }
 
-    delete[] line_buffer;
-    delete[] line_buffer2;
+    plane_pool__release(line_buffer);
+    plane_pool__release(line_buffer2);
     std::cout << "sinc interpolation done: 3x, H = " << H << "\n";
 }
 
 /*****************************************************************************/
-/*                  my_aligned_image_comp::differentiation                   */
+/*                      my_image_view::differentiation                       */
 /*****************************************************************************/
-float* my_aligned_image_comp::differentiation(my_aligned_image_comp* in, float g, std::string mode) {
+float* my_image_view::differentiation(const my_image_view &in, float g, std::string mode) {
     const int FILTER_EXTENT = 1;
     const int FILTER_TAPS = (2 * FILTER_EXTENT + 1);
 
@@ -287,12 +706,12 @@ float* my_aligned_image_comp::differentiation(my_aligned_image_comp* in, float g
     float* mirror_psf = filter_buf + FILTER_EXTENT; // `mirror_psf' points to the central tap in the filter
 
     // Check for consistent dimensions
-    assert(in->border >= FILTER_EXTENT);
-    //assert((this->height <= in->height) && (this->width <= in->width));
+    assert(in.border >= FILTER_EXTENT);
+    //assert((this->height <= in.height) && (this->width <= in.width));
 
     // Allocate magnitute buffers and rgb buffer    
-    float* rgb_buffer = new float[height * width * 3];
-    float* magnitude = new float[height * width];
+    float* rgb_buffer = plane_pool__take(height * width * 3, MY_COMP_ALIGNMENT);
+    float* magnitude = plane_pool__take(height * width, MY_COMP_ALIGNMENT);
 
     std::cout << "begin filtering...\n";
     // Combined vertical + horizontal convolution row-by-row
@@ -307,13 +726,13 @@ float* my_aligned_image_comp::differentiation(my_aligned_image_comp* in, float g
 
             // 1. vertical filtering
             for (int y = -FILTER_EXTENT; y <= FILTER_EXTENT; ++y) {
-                float* ip = in->buf + (r + y) * in->stride + c;
+                float* ip = in.buf + (r + y) * in.stride + c;
                 sum_fy += (*ip) * mirror_psf[y];
             }
 
             // 2. horizontal filtering
             for (int x = -FILTER_EXTENT; x <= FILTER_EXTENT; ++x) {
-                float* ip = in->buf + r * in->stride + (c + x);
+                float* ip = in.buf + r * in.stride + (c + x);
                 sum_fx += (*ip) * mirror_psf[x];
             }
 
@@ -349,7 +768,7 @@ float* my_aligned_image_comp::differentiation(my_aligned_image_comp* in, float g
 
     if (mode == "on") {
         std::cout << "differentiation done: g = " << g << "\n";
-        delete[] magnitude;
+        plane_pool__release(magnitude);
         return rgb_buffer;
     }
     else if (mode == "off") {
@@ -371,25 +790,33 @@ float* my_aligned_image_comp::differentiation(my_aligned_image_comp* in, float g
             }
         }
         std::cout << "differentiation done: g = " << g << "\n";
-        delete[] magnitude;
+        plane_pool__release(magnitude);
         return rgb_buffer;
     }
     else {
         std::cout << "Invalid mode type\n";
+        plane_pool__release(magnitude);
+        plane_pool__release(rgb_buffer);
         return nullptr;
     }
 }
 
 /*****************************************************************************/
-/*                  my_aligned_image_comp::sinc_interpolation                */
+/*                    my_image_view::derivative_gaussian                     */
 /*****************************************************************************/
-float* my_aligned_image_comp::derivative_gaussian(my_aligned_image_comp* in, float s, std::string mode) {
+
+// Shared by both forms of `my_image_view::derivative_gaussian', for an
+// output of `height' x `width'; `cols' is NULL when `in' has a real border
+static float* derivative_gaussian_rows(int height, int width,
+                                       const my_image_view &in, float s,
+                                       std::string mode,
+                                       const boundary_remap* cols) {
     int s0 = static_cast<int>(s + 1.0F);
     int FILTER_EXTENT = 3 * s0;
     int FILTER_TAPS = (2 * FILTER_EXTENT + 1);
 
     // Creat Gaussian PSF as an array on the heap
-    float* filter_buf_g = new float[FILTER_TAPS]; 
+    float* filter_buf_g = plane_pool__take(FILTER_TAPS, MY_COMP_ALIGNMENT); 
     float* mirror_psf_g = filter_buf_g + FILTER_EXTENT; // `mirror_psf' points to the central tap in the filter
     float gsum = 0.0F;
     for (int i = -FILTER_EXTENT; i <= FILTER_EXTENT; ++i) {
@@ -401,7 +828,7 @@ float* my_aligned_image_comp::derivative_gaussian(my_aligned_image_comp* in, flo
     }
 
     // Creat Derivative Gaussian PSF as a array on the heap
-    float* filter_buf_dg = new float[FILTER_TAPS];
+    float* filter_buf_dg = plane_pool__take(FILTER_TAPS, MY_COMP_ALIGNMENT);
     float* mirror_psf_dg = filter_buf_dg + FILTER_EXTENT; // `mirror_psf' points to the central tap in the filter
     for (int i = -FILTER_EXTENT; i <= FILTER_EXTENT; ++i) {
         mirror_psf_dg[i] = -i / (s * s) * (1.0F / (std::sqrtf(2 * pi) * s) * (std::expf(-(i * i) / (2 * s * s)))); // no need to normalize Derivateive Filter
@@ -410,30 +837,45 @@ float* my_aligned_image_comp::derivative_gaussian(my_aligned_image_comp* in, flo
     // ? is it a good tradeoff to replace stack allocation with heap allocation just to make the function parameter more flexible??
     // todo: 1. convolution step by step 2. remember to delete two kernel arrys 3. the reset should be fine as to follow the differentiation method to do the Hue Color Space conversion.
     // Check for consistent dimensions
-    assert(in->border >= FILTER_EXTENT);
-    //assert((this->height <= in->height) && (this->width <= in->width));
+    assert((cols != NULL) || (in.border >= FILTER_EXTENT));
+    //assert((this->height <= in.height) && (this->width <= in.width));
     
     // Allocate magnitute buffers and rgb buffer    
-    float* rgb_buffer = new float[height * width * 3];
-    float* magnitude = new float[height * width];
+    float* rgb_buffer = plane_pool__take(height * width * 3, MY_COMP_ALIGNMENT);
+    float* magnitude = plane_pool__take(height * width, MY_COMP_ALIGNMENT);
 
     // ---------- 新增：横向临时缓冲 ----------
-    float* row_g = new float[height * width];  // I ⊗ g   (行)
-    float* row_dg = new float[height * width];  // I ⊗ g'  (行)
+    float* row_g = plane_pool__take(height * width, MY_COMP_ALIGNMENT);  // I ⊗ g   (行)
+    float* row_dg = plane_pool__take(height * width, MY_COMP_ALIGNMENT);  // I ⊗ g'  (行)
     std::cout << "begin filtering...\n";
-    // 1. First do horizontal filtering
+    // 1. First do horizontal filtering, with the vector kernels of
+    // "simd_filter.h".  Without a real border, columns outside [lo,hi)
+    // read their taps through the remap table instead
+    int lo = 0, hi = width;
+    if (cols != NULL) {
+        lo = std::min(FILTER_EXTENT, width);
+        hi = std::max(lo, std::min(width, in.width - FILTER_EXTENT));
+    }
     for (int r = 0; r < height; ++r) {
+        const float* line_in = in.row(r);
+        simd_filter__horizontal(row_g + r * width + lo, line_in + lo,
+                                mirror_psf_g, FILTER_EXTENT, hi - lo);   // I ⊗ g
+        simd_filter__horizontal(row_dg + r * width + lo, line_in + lo,
+                                mirror_psf_dg, FILTER_EXTENT, hi - lo);  // I ⊗ g'
         for (int c = 0; c < width; ++c) {
+            if (c == lo)
+                c = hi; // Skip the columns done above
+            if (c == width)
+                break;
             float acc_g = 0.0F;
             float acc_dg = 0.0F;
             for (int dx = -FILTER_EXTENT; dx <= FILTER_EXTENT; ++dx) {
-                float* ip = in->buf + r * in->stride + (c + dx);
-                float  val = *ip;
+                float val = cols->sample(line_in, c + dx);
                 acc_g += val * mirror_psf_g[dx];
                 acc_dg += val * mirror_psf_dg[dx];
             }
-            row_g[r * width + c] = acc_g;   // I ⊗ g
-            row_dg[r * width + c] = acc_dg;  // I ⊗ g'
+            row_g[r * width + c] = acc_g;
+            row_dg[r * width + c] = acc_dg;
         }
     }
     
@@ -489,11 +931,11 @@ float* my_aligned_image_comp::derivative_gaussian(my_aligned_image_comp* in, flo
 
     if (mode == "on") {
         std::cout << "Derivative Gaussian done: sigma = " << s << "\n";
-        delete[] magnitude;
-        delete[] filter_buf_g;
-        delete[] filter_buf_dg;
-        delete[] row_dg;
-        delete[] row_g;
+        plane_pool__release(magnitude);
+        plane_pool__release(filter_buf_g);
+        plane_pool__release(filter_buf_dg);
+        plane_pool__release(row_dg);
+        plane_pool__release(row_g);
         return rgb_buffer;
     }
     else if (mode == "off") {
@@ -515,21 +957,31 @@ float* my_aligned_image_comp::derivative_gaussian(my_aligned_image_comp* in, flo
             }
         }
         std::cout << "Derivative Gaussian done: sigma = " << s << "\n";
-        delete[] magnitude;
-        delete[] row_dg;
-        delete[] filter_buf_g;
-        delete[] filter_buf_dg;
-        delete[] row_g;
+        plane_pool__release(magnitude);
+        plane_pool__release(row_dg);
+        plane_pool__release(filter_buf_g);
+        plane_pool__release(filter_buf_dg);
+        plane_pool__release(row_g);
         return rgb_buffer;
     }
     else {
         std::cout << "Invalid mode type\n";
-        delete[] magnitude;
-        delete[] row_dg;
-        delete[] row_g;
-        delete[] filter_buf_g;
-        delete[] filter_buf_dg;
-        delete[] rgb_buffer;
+        plane_pool__release(magnitude);
+        plane_pool__release(row_dg);
+        plane_pool__release(row_g);
+        plane_pool__release(filter_buf_g);
+        plane_pool__release(filter_buf_dg);
+        plane_pool__release(rgb_buffer);
         return nullptr;
     }
+}
+
+float* my_image_view::derivative_gaussian(const my_image_view &in, float s, std::string mode) {
+    return derivative_gaussian_rows(height, width, in, s, mode, NULL);
+}
+
+float* my_image_view::derivative_gaussian(const my_image_view &in, float s, std::string mode,
+                                          BoundaryExtensionType ext) {
+    boundary_remap cols(ext, in.width, 3 * static_cast<int>(s + 1.0F));
+    return derivative_gaussian_rows(height, width, in, s, mode, &cols);
 }
\ No newline at end of file
@@ -0,0 +1,1252 @@
+/*****************************************************************************/
+// File: comp_io.cpp
+/*****************************************************************************/
+
+#include <string.h>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <vector>
+#include <string>
+#include <emmintrin.h>
+#include <tmmintrin.h>
+#include "comp_io.h"
+#include "cpu_features.h"
+#include "io_stats.h"
+#include "thread_stripes.h"
+
+/* ========================================================================= */
+/*                             Internal Functions                            */
+/* ========================================================================= */
+
+/*****************************************************************************/
+/* INLINE                      file_line_to_row                              */
+/*****************************************************************************/
+
+static inline int
+  file_line_to_row(int idx, int rows, int top_down)
+  /* Converts the index of a line within the file to a true row index. */
+{
+  return (top_down)?idx:(rows-1-idx);
+}
+
+/*****************************************************************************/
+/* INLINE                        widen_store                                 */
+/*****************************************************************************/
+
+static inline void
+  widen_store(__m128i bytes, float *dst)
+  /* Converts 16 unsigned bytes to floats, writing them to `dst'. */
+{
+  __m128i zero = _mm_setzero_si128();
+  __m128i lo = _mm_unpacklo_epi8(bytes,zero);
+  __m128i hi = _mm_unpackhi_epi8(bytes,zero);
+  _mm_storeu_ps(dst,   _mm_cvtepi32_ps(_mm_unpacklo_epi16(lo,zero)));
+  _mm_storeu_ps(dst+4, _mm_cvtepi32_ps(_mm_unpackhi_epi16(lo,zero)));
+  _mm_storeu_ps(dst+8, _mm_cvtepi32_ps(_mm_unpacklo_epi16(hi,zero)));
+  _mm_storeu_ps(dst+12,_mm_cvtepi32_ps(_mm_unpackhi_epi16(hi,zero)));
+}
+
+/*****************************************************************************/
+/* STATIC                       decode_grey_sse2                             */
+/*****************************************************************************/
+
+static int
+  decode_grey_sse2(const io_byte *line, float *dst, int width)
+  /* Returns the number of samples converted, a multiple of 16. */
+{
+  int c = 0;
+  for (; (c+16) <= width; c+=16)
+    widen_store(_mm_loadu_si128((const __m128i *)(line+c)),dst+c);
+  return c;
+}
+
+/*****************************************************************************/
+/* STATIC                       decode_bgr_ssse3                             */
+/*****************************************************************************/
+
+SIMD_TARGET_SSSE3 static int
+  decode_bgr_ssse3(const io_byte *line, float *dst0, float *dst1,
+                   float *dst2, int width)
+  /* Deinterleaves 16 pixels (48 bytes) at a time, returning the number of
+     pixels converted.  Each output register gathers the bytes of one
+     component from all three input registers, using `pshufb' masks whose
+     negative entries produce zeros so that the partial results can simply
+     be OR'ed together. */
+{
+  const __m128i b0 = _mm_setr_epi8(0,3,6,9,12,15,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1);
+  const __m128i b1 = _mm_setr_epi8(-1,-1,-1,-1,-1,-1,2,5,8,11,14,-1,-1,-1,-1,-1);
+  const __m128i b2 = _mm_setr_epi8(-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,1,4,7,10,13);
+  const __m128i g0 = _mm_setr_epi8(1,4,7,10,13,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1);
+  const __m128i g1 = _mm_setr_epi8(-1,-1,-1,-1,-1,0,3,6,9,12,15,-1,-1,-1,-1,-1);
+  const __m128i g2 = _mm_setr_epi8(-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,2,5,8,11,14);
+  const __m128i r0 = _mm_setr_epi8(2,5,8,11,14,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1);
+  const __m128i r1 = _mm_setr_epi8(-1,-1,-1,-1,-1,1,4,7,10,13,-1,-1,-1,-1,-1,-1);
+  const __m128i r2 = _mm_setr_epi8(-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,0,3,6,9,12,15);
+  int c = 0;
+  for (; (c+16) <= width; c+=16, line+=48)
+    {
+      __m128i v0 = _mm_loadu_si128((const __m128i *)(line));
+      __m128i v1 = _mm_loadu_si128((const __m128i *)(line+16));
+      __m128i v2 = _mm_loadu_si128((const __m128i *)(line+32));
+      __m128i b = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(v0,b0),
+                                            _mm_shuffle_epi8(v1,b1)),
+                               _mm_shuffle_epi8(v2,b2));
+      __m128i g = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(v0,g0),
+                                            _mm_shuffle_epi8(v1,g1)),
+                               _mm_shuffle_epi8(v2,g2));
+      __m128i r = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(v0,r0),
+                                            _mm_shuffle_epi8(v1,r1)),
+                               _mm_shuffle_epi8(v2,r2));
+      widen_store(b,dst0+c);
+      widen_store(g,dst1+c);
+      widen_store(r,dst2+c);
+    }
+  return c;
+}
+
+/*****************************************************************************/
+/* STATIC                       decode_bgra_sse2                             */
+/*****************************************************************************/
+
+static int
+  decode_bgra_sse2(const io_byte *line, float *dst0, float *dst1,
+                   float *dst2, int width)
+  /* Converts 4 pixels (16 bytes) at a time, returning the number of pixels
+     converted.  Each pixel fills one 32-bit lane, so each component is
+     isolated by a shift and mask within the lane and converted directly,
+     with no shuffling; the alpha bytes are simply never extracted. */
+{
+  const __m128i mask = _mm_set1_epi32(0xFF);
+  int c = 0;
+  for (; (c+4) <= width; c+=4, line+=16)
+    {
+      __m128i v = _mm_loadu_si128((const __m128i *) line);
+      _mm_storeu_ps(dst0+c,_mm_cvtepi32_ps(_mm_and_si128(v,mask)));
+      _mm_storeu_ps(dst1+c,_mm_cvtepi32_ps(
+                      _mm_and_si128(_mm_srli_epi32(v,8),mask)));
+      _mm_storeu_ps(dst2+c,_mm_cvtepi32_ps(
+                      _mm_and_si128(_mm_srli_epi32(v,16),mask)));
+    }
+  return c;
+}
+
+/*****************************************************************************/
+/* INLINE                        quantize16                                  */
+/*****************************************************************************/
+
+static inline __m128i
+  quantize16(const float *src)
+  /* Rounds and clamps 16 floats to unsigned bytes, matching the scalar
+     conversion `(io_byte) std::clamp(x+0.5F,0.0F,255.0F)' exactly.  Only the
+     upper limit needs an explicit `min', to keep huge values from wrapping
+     in the integer conversion; everything else is left to the saturating
+     `packs'/`packus' instructions. */
+{
+  __m128 half = _mm_set1_ps(0.5F), top = _mm_set1_ps(255.0F);
+  __m128i i0 = _mm_cvttps_epi32(_mm_min_ps(_mm_add_ps(_mm_loadu_ps(src),
+                                                      half),top));
+  __m128i i1 = _mm_cvttps_epi32(_mm_min_ps(_mm_add_ps(_mm_loadu_ps(src+4),
+                                                      half),top));
+  __m128i i2 = _mm_cvttps_epi32(_mm_min_ps(_mm_add_ps(_mm_loadu_ps(src+8),
+                                                      half),top));
+  __m128i i3 = _mm_cvttps_epi32(_mm_min_ps(_mm_add_ps(_mm_loadu_ps(src+12),
+                                                      half),top));
+  return _mm_packus_epi16(_mm_packs_epi32(i0,i1),_mm_packs_epi32(i2,i3));
+}
+
+/*****************************************************************************/
+/* INLINE                      quantize_scalar                               */
+/*****************************************************************************/
+
+static inline io_byte
+  quantize_scalar(float x)
+{
+  x += 0.5F;
+  return (io_byte)((x < 0.0F)?0.0F:((x > 255.0F)?255.0F:x));
+}
+
+/*****************************************************************************/
+/* STATIC                       encode_flat_sse2                             */
+/*****************************************************************************/
+
+static int
+  encode_flat_sse2(const float *src, io_byte *dst, int num_samples)
+  /* Returns the number of samples converted, a multiple of 16. */
+{
+  int c = 0;
+  for (; (c+16) <= num_samples; c+=16)
+    _mm_storeu_si128((__m128i *)(dst+c),quantize16(src+c));
+  return c;
+}
+
+/*****************************************************************************/
+/* STATIC                       encode_bgr_ssse3                             */
+/*****************************************************************************/
+
+SIMD_TARGET_SSSE3 static int
+  encode_bgr_ssse3(const float *src0, const float *src1, const float *src2,
+                   io_byte *line, int width)
+  /* Inverse of `decode_bgr_ssse3': quantizes 16 pixels of each plane and
+     scatters them into 48 interleaved bytes.  Returns the number of pixels
+     converted. */
+{
+  const __m128i b0 = _mm_setr_epi8(0,-1,-1,1,-1,-1,2,-1,-1,3,-1,-1,4,-1,-1,5);
+  const __m128i b1 = _mm_setr_epi8(-1,-1,6,-1,-1,7,-1,-1,8,-1,-1,9,-1,-1,10,-1);
+  const __m128i b2 = _mm_setr_epi8(-1,11,-1,-1,12,-1,-1,13,-1,-1,14,-1,-1,15,-1,-1);
+  const __m128i g0 = _mm_setr_epi8(-1,0,-1,-1,1,-1,-1,2,-1,-1,3,-1,-1,4,-1,-1);
+  const __m128i g1 = _mm_setr_epi8(5,-1,-1,6,-1,-1,7,-1,-1,8,-1,-1,9,-1,-1,10);
+  const __m128i g2 = _mm_setr_epi8(-1,-1,11,-1,-1,12,-1,-1,13,-1,-1,14,-1,-1,15,-1);
+  const __m128i r0 = _mm_setr_epi8(-1,-1,0,-1,-1,1,-1,-1,2,-1,-1,3,-1,-1,4,-1);
+  const __m128i r1 = _mm_setr_epi8(-1,5,-1,-1,6,-1,-1,7,-1,-1,8,-1,-1,9,-1,-1);
+  const __m128i r2 = _mm_setr_epi8(10,-1,-1,11,-1,-1,12,-1,-1,13,-1,-1,14,-1,-1,15);
+  int c = 0;
+  for (; (c+16) <= width; c+=16, line+=48)
+    {
+      __m128i b = quantize16(src0+c);
+      __m128i g = quantize16(src1+c);
+      __m128i r = quantize16(src2+c);
+      __m128i v0 = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(b,b0),
+                                             _mm_shuffle_epi8(g,g0)),
+                                _mm_shuffle_epi8(r,r0));
+      __m128i v1 = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(b,b1),
+                                             _mm_shuffle_epi8(g,g1)),
+                                _mm_shuffle_epi8(r,r1));
+      __m128i v2 = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(b,b2),
+                                             _mm_shuffle_epi8(g,g2)),
+                                _mm_shuffle_epi8(r,r2));
+      _mm_storeu_si128((__m128i *)(line),v0);
+      _mm_storeu_si128((__m128i *)(line+16),v1);
+      _mm_storeu_si128((__m128i *)(line+32),v2);
+    }
+  return c;
+}
+
+/*****************************************************************************/
+/* STATIC                      extend_row_edges                              */
+/*****************************************************************************/
+
+static void
+  extend_row_edges(my_aligned_image_comp *comp, int r)
+  /* Zero-order hold into the left and right border columns of row `r',
+     followed by replication of the whole row into the top or bottom border
+     if `r' is the first or last image row. */
+{
+  int border = comp->border;
+  float *row = comp->buf + r*comp->stride;
+  if (border > 0)
+    {
+      float left = row[0], right = row[comp->width-1];
+      for (int c=1; c <= border; c++)
+        { row[-c] = left;  row[comp->width-1+c] = right; }
+    }
+  size_t row_bytes = sizeof(float) * (size_t)(comp->width + 2*border);
+  float *src = row - border;
+  if (r == 0)
+    for (int b=1; b <= border; b++)
+      memcpy(src - b*comp->stride,src,row_bytes);
+  if (r == (comp->height-1))
+    for (int b=1; b <= border; b++)
+      memcpy(src + b*comp->stride,src,row_bytes);
+}
+
+/*****************************************************************************/
+/* STATIC                        decode_samples                              */
+/*****************************************************************************/
+
+static void
+  decode_samples(const io_byte *line, int num_comps, float * const *dst,
+                 int width)
+  /* Converts `width' pixels of `num_comps' (1 or 3) interleaved bytes to
+     float, writing the n'th sample of each pixel to `dst[n]'.  A
+     `num_comps' value of 4 denotes BGRA pixels, whose alpha samples are
+     dropped, so only `dst[0]' to `dst[2]' are written. */
+{
+  int c = 0; // Number of pixels already converted by a vector routine
+  if (num_comps == 1)
+    c = decode_grey_sse2(line,dst[0],width);
+  else if ((num_comps == 3) && (cpu_simd_level() >= CPU_SIMD_SSSE3))
+    c = decode_bgr_ssse3(line,dst[0],dst[1],dst[2],width);
+  else if (num_comps == 4)
+    c = decode_bgra_sse2(line,dst[0],dst[1],dst[2],width);
+  int num_planes = (num_comps == 4)?3:num_comps;
+  for (int n=0; n < num_planes; n++)
+    {
+      const io_byte *src = line + c*num_comps + n;
+      float *dp = dst[n];
+      for (int k=c; k < width; k++, src+=num_comps)
+        dp[k] = (float) *src;
+    }
+}
+
+/*****************************************************************************/
+/* STATIC                       decode_samples16                             */
+/*****************************************************************************/
+
+static void
+  decode_samples16(const io_byte *line, int num_comps, float * const *dst,
+                   int width, double scale, bool little_endian)
+  /* As above, but for 16-bit samples, big-endian unless `little_endian' is
+     true, which are multiplied by `scale'.  The product is formed in
+     double precision so that samples which are exact multiples of
+     `1/scale' (e.g., 8-bit values stored as v*257) come out as exact
+     integers. */
+{
+  int hi = (little_endian)?1:0, lo = 1-hi;
+  for (int n=0; n < num_comps; n++)
+    {
+      const io_byte *src = line + 2*n;
+      float *dp = dst[n];
+      for (int k=0; k < width; k++, src+=2*num_comps)
+        dp[k] = (float)(scale * ((((int) src[hi]) << 8) | src[lo]));
+    }
+}
+
+/*****************************************************************************/
+/* STATIC                        encode_samples16                            */
+/*****************************************************************************/
+
+static void
+  encode_samples16(const float * const *src, int num_comps, int width,
+                   io_byte *line, float scale, int max_val)
+  /* Inverse of `decode_samples16': multiplies each sample by `scale', then
+     rounds and clamps it to [0,`max_val']. */
+{
+  for (int n=0; n < num_comps; n++)
+    {
+      const float *sp = src[n];
+      io_byte *dst = line + 2*n;
+      for (int k=0; k < width; k++, dst+=2*num_comps)
+        {
+          float x = sp[k]*scale + 0.5F;
+          float top = (float) max_val;
+          int val = (int)((x < 0.0F)?0.0F:((x > top)?top:x));
+          dst[0] = (io_byte)(val >> 8);  dst[1] = (io_byte) val;
+        }
+    }
+}
+
+/*****************************************************************************/
+/* STATIC                         decode_pnm_line                            */
+/*****************************************************************************/
+
+static void
+  decode_pnm_line(const io_byte *line, const pnm_in *in,
+                  my_aligned_image_comp *comps, int r)
+  /* PGM/PPM counterpart of `comp_io__decode_line'.  RGB samples are
+     delivered to `comps' in BGR order, as for a BMP file, and 16-bit
+     samples are scaled to the same nominal range of 0 to 255. */
+{
+  int num_comps = in->num_components;
+  float *dst[3] = {NULL,NULL,NULL};
+  for (int n=0; n < num_comps; n++)
+    dst[num_comps-1-n] = comps[n].buf + r*comps[n].stride;
+  if (in->sample_bytes == 1)
+    { // Samples can be taken as they are unless `max_val' is unusual
+      decode_samples(line,num_comps,dst,comps[0].width);
+      if (in->max_val != 255)
+        for (int n=0; n < num_comps; n++)
+          for (int k=0; k < comps[0].width; k++)
+            dst[n][k] = (float)(dst[n][k] * (255.0 / in->max_val));
+    }
+  else
+    decode_samples16(line,num_comps,dst,comps[0].width,
+                     255.0 / in->max_val,in->little_endian);
+  for (int n=0; n < num_comps; n++)
+    extend_row_edges(comps+n,r);
+}
+
+/*****************************************************************************/
+/* STATIC                         encode_pnm_line                            */
+/*****************************************************************************/
+
+static void
+  encode_pnm_line(const float * const *planes, const pnm_out *out,
+                  io_byte *line)
+  /* Inverse of `decode_pnm_line': `planes' holds one row of each component
+     in BGR order (for colour files). */
+{
+  int num_comps = out->num_components;
+  const float *src[3];
+  for (int n=0; n < num_comps; n++)
+    src[num_comps-1-n] = planes[n];
+  if ((out->sample_bytes == 1) && (out->max_val == 255))
+    comp_io__encode_line(src,num_comps,out->cols,line);
+  else if (out->sample_bytes == 1)
+    {
+      float scale = (float) out->max_val / 255.0F;
+      for (int n=0; n < num_comps; n++)
+        for (int k=0; k < out->cols; k++)
+          {
+            float x = src[n][k]*scale + 0.5F;
+            line[k*num_comps+n] = (io_byte)
+              ((x < 0.0F)?0.0F:((x > (float) out->max_val)?
+                                (float) out->max_val:x));
+          }
+    }
+  else
+    encode_samples16(src,num_comps,out->cols,line,
+                     (float) out->max_val / 255.0F,out->max_val);
+}
+
+/*****************************************************************************/
+/* STRUCT                        comp_io_async                               */
+/*****************************************************************************/
+
+struct comp_io_async {
+    int lines_done; // Lines decoded so far, in file order
+    bool done; // Set once the thread has nothing more to do
+    int err_code;
+    std::mutex mutex;
+    std::condition_variable progress;
+    std::thread thread;
+  };
+
+/*****************************************************************************/
+/* STATIC                           read_bmp                                 */
+/*****************************************************************************/
+
+static int
+  read_bmp(bmp_in *in, my_aligned_image_comp *comps, comp_io_async *job)
+  /* Implements `comp_io__read_bmp'.  If `job' is non-NULL, progress is
+     published to it after every block of lines. */
+{
+  int num_comps = in->pixel_bytes; // 4 for BGRA lines
+  const int block_lines = 64; // Lines decoded between progress reports
+  io_byte *block = NULL;
+  if (in->first_line == NULL)
+    block = new io_byte[((size_t) in->line_bytes) * block_lines];
+  int err_code = 0, lines_done = 0;
+  int r_step = (in->top_down)?1:-1;
+  while (in->num_unread_rows > 0)
+    {
+      int r = file_line_to_row(in->rows-in->num_unread_rows,in->rows,
+                               in->top_down);
+      int num_lines = in->num_unread_rows;
+      if (num_lines > block_lines)
+        num_lines = block_lines;
+      if (block == NULL)
+        { // Decode straight out of the mapped file
+          long long start = io_stats__start(in->stats);
+          for (int k=0; k < num_lines; k++, r+=r_step)
+            comp_io__decode_line(bmp_in__next_line_ptr(in),num_comps,
+                                 comps,r);
+          io_stats__add_convert(in->stats,start);
+        }
+      else
+        {
+          if ((err_code = bmp_in__get_lines(in,block,num_lines)) != 0)
+            break;
+          long long start = io_stats__start(in->stats);
+          const io_byte *line = block;
+          for (int k=0; k < num_lines; k++, r+=r_step, line+=in->line_bytes)
+            comp_io__decode_line(line,num_comps,comps,r);
+          io_stats__add_convert(in->stats,start);
+        }
+      lines_done += num_lines;
+      if (job != NULL)
+        {
+          {
+            std::lock_guard<std::mutex> lock(job->mutex);
+            job->lines_done = lines_done;
+          }
+          job->progress.notify_all();
+        }
+    }
+  delete[] block;
+  return err_code;
+}
+
+
+/*****************************************************************************/
+/* TEMPLATE                     write_bmp_stripes                            */
+/*****************************************************************************/
+
+template<class Encode> static int
+  write_bmp_stripes(bmp_out *out, int num_threads, Encode encode_row)
+  /* Common implementation of the parallel writers: preallocates `out' if
+     necessary, then has each of `num_threads' stripes encode its rows in
+     blocks, using `encode_row(r,line)', and write them with
+     `bmp_out__write_rows'.  Mapped files are encoded in place. */
+{
+  if (!out->preallocated)
+    {
+      int err_code = bmp_out__preallocate(out);
+      if (err_code != 0)
+        return err_code;
+    }
+  std::vector<int> stripe_err(num_threads > 0 ? num_threads : 1, 0);
+  run_stripes(out->rows,num_threads,[&](int first_row, int lim_row, int s)
+    {
+      if (out->first_line != NULL)
+        { // Encode straight into the mapped file
+          long long start = io_stats__start(out->stats);
+          for (int r=first_row; r < lim_row; r++)
+            encode_row(r,bmp_out__row_ptr(out,r));
+          io_stats__add_convert(out->stats,start);
+          io_stats__add_rows(out->stats,lim_row-first_row);
+          return;
+        }
+      const int block_lines = 64; // Rows passed to each positional write
+      io_byte *block = new io_byte[((size_t) out->line_bytes) * block_lines];
+      for (int r=first_row; r < lim_row; )
+        {
+          int num_rows = lim_row - r;
+          if (num_rows > block_lines)
+            num_rows = block_lines;
+          long long start = io_stats__start(out->stats);
+          io_byte *line = block;
+          for (int k=0; k < num_rows; k++, line+=out->line_bytes)
+            encode_row(r+k,line);
+          io_stats__add_convert(out->stats,start);
+          if ((stripe_err[s] =
+               bmp_out__write_rows(out,r,num_rows,block)) != 0)
+            break;
+          r += num_rows;
+        }
+      delete[] block;
+    });
+  for (size_t s=0; s < stripe_err.size(); s++)
+    if (stripe_err[s] != 0)
+      return stripe_err[s];
+  return 0;
+}
+
+/*****************************************************************************/
+/* TEMPLATE                     write_pnm_stripes                            */
+/*****************************************************************************/
+
+template<class Encode> static int
+  write_pnm_stripes(pnm_out *out, int num_threads, size_t scratch_floats,
+                    Encode encode_row)
+  /* Counterpart of `write_bmp_stripes' for PGM/PPM files.  Mapped files
+     are encoded in place by `num_threads' threads; otherwise the lines are
+     encoded in blocks and written in order by the calling thread.
+     `encode_row(r,line,scratch)' may use `scratch_floats' floats at
+     `scratch' as it likes; each stripe takes its own scratch buffer from
+     the plane pool once, for all of its rows. */
+{
+  if (out->first_line != NULL)
+    {
+      out->num_unwritten_rows = 0;
+      run_stripes(out->rows,num_threads,[&](int first_row, int lim_row, int /*s*/)
+        {
+          float *scratch = NULL;
+          if (scratch_floats > 0)
+            scratch = plane_pool__take(scratch_floats,MY_COMP_ALIGNMENT);
+          for (int r=first_row; r < lim_row; r++)
+            encode_row(r,pnm_out__row_ptr(out,r),scratch);
+          plane_pool__release(scratch);
+        });
+      return 0;
+    }
+  if (out->out == NULL)
+    return(IO_ERR_FILE_NOT_OPEN);
+  const int block_lines = 64; // Lines passed to each `pnm_out__put_lines'
+  io_byte *block = new io_byte[((size_t) out->line_bytes) * block_lines];
+  float *scratch = NULL;
+  if (scratch_floats > 0)
+    scratch = plane_pool__take(scratch_floats,MY_COMP_ALIGNMENT);
+  int err_code = 0;
+  while (out->num_unwritten_rows > 0)
+    {
+      int r = out->rows - out->num_unwritten_rows;
+      int num_lines = out->num_unwritten_rows;
+      if (num_lines > block_lines)
+        num_lines = block_lines;
+      io_byte *line = block;
+      for (int k=0; k < num_lines; k++, line+=out->line_bytes)
+        encode_row(r+k,line,scratch);
+      if ((err_code = pnm_out__put_lines(out,block,num_lines)) != 0)
+        break;
+    }
+  plane_pool__release(scratch);
+  delete[] block;
+  return err_code;
+}
+
+/* ========================================================================= */
+/*                             External Functions                            */
+/* ========================================================================= */
+
+/*****************************************************************************/
+/*                            comp_io__decode_line                           */
+/*****************************************************************************/
+
+void comp_io__decode_line(const io_byte *line, int num_comps,
+                          my_aligned_image_comp *comps, int r)
+{
+  int num_planes = (num_comps == 4)?3:num_comps;
+  float *dst[3] = {NULL,NULL,NULL};
+  for (int n=0; n < num_planes; n++)
+    dst[n] = comps[n].buf + r*comps[n].stride;
+  decode_samples(line,num_comps,dst,comps[0].width);
+  for (int n=0; n < num_planes; n++)
+    extend_row_edges(comps+n,r);
+}
+
+/*****************************************************************************/
+/*                             comp_io__read_bmp                             */
+/*****************************************************************************/
+
+int comp_io__read_bmp(bmp_in *in, my_aligned_image_comp *comps)
+{
+  return read_bmp(in,comps,NULL);
+}
+
+/*****************************************************************************/
+/*                         comp_io__read_bmp_parallel                        */
+/*****************************************************************************/
+
+int comp_io__read_bmp_parallel(bmp_in *in, my_aligned_image_comp *comps,
+                               int num_threads)
+{
+  if ((in->in == NULL) && (in->first_line == NULL))
+    return(IO_ERR_FILE_NOT_OPEN);
+  int num_comps = in->pixel_bytes;
+  std::vector<int> stripe_err(num_threads > 0 ? num_threads : 1, 0);
+  run_stripes(in->rows,num_threads,[&](int first_row, int lim_row, int s)
+    {
+      if (in->first_line != NULL)
+        { // Decode straight out of the mapped file
+          long long start = io_stats__start(in->stats);
+          for (int r=first_row; r < lim_row; r++)
+            comp_io__decode_line(bmp_in__row_ptr(in,r),num_comps,comps,r);
+          io_stats__add_convert(in->stats,start);
+          io_stats__add_rows(in->stats,lim_row-first_row);
+          return;
+        }
+      const int block_lines = 64; // Rows fetched by each positional read
+      io_byte *block = new io_byte[((size_t) in->line_bytes) * block_lines];
+      for (int r=first_row; r < lim_row; )
+        {
+          int num_rows = lim_row - r;
+          if (num_rows > block_lines)
+            num_rows = block_lines;
+          if ((stripe_err[s] =
+               bmp_in__read_rows(in,r,num_rows,block)) != 0)
+            break;
+          long long start = io_stats__start(in->stats);
+          const io_byte *line = block;
+          for (; num_rows > 0; num_rows--, r++, line+=in->line_bytes)
+            comp_io__decode_line(line,num_comps,comps,r);
+          io_stats__add_convert(in->stats,start);
+        }
+      delete[] block;
+    });
+  for (size_t s=0; s < stripe_err.size(); s++)
+    if (stripe_err[s] != 0)
+      return stripe_err[s];
+  return 0;
+}
+
+/*****************************************************************************/
+/*                            comp_io__start_read                            */
+/*****************************************************************************/
+
+comp_io_async *comp_io__start_read(bmp_in *in, my_aligned_image_comp *comps)
+{
+  comp_io_async *job = new comp_io_async;
+  job->lines_done = 0;
+  job->done = false;
+  job->err_code = 0;
+  job->thread = std::thread([job,in,comps]{
+      int err_code = read_bmp(in,comps,job);
+      {
+        std::lock_guard<std::mutex> lock(job->mutex);
+        job->err_code = err_code;
+        job->done = true;
+      }
+      job->progress.notify_all();
+    });
+  return job;
+}
+
+/*****************************************************************************/
+/*                            comp_io__wait_lines                            */
+/*****************************************************************************/
+
+int comp_io__wait_lines(comp_io_async *job, int num_lines)
+{
+  std::unique_lock<std::mutex> lock(job->mutex);
+  job->progress.wait(lock,[&]{ return job->done ||
+                                      (job->lines_done >= num_lines); });
+  if (job->lines_done >= num_lines)
+    return 0;
+  return (job->err_code != 0)?job->err_code:IO_ERR_FILE_NOT_OPEN;
+}
+
+/*****************************************************************************/
+/*                            comp_io__finish_read                           */
+/*****************************************************************************/
+
+int comp_io__finish_read(comp_io_async *job)
+{
+  job->thread.join();
+  int err_code = job->err_code;
+  delete job;
+  return err_code;
+}
+
+/*****************************************************************************/
+/*                            comp_io__encode_line                           */
+/*****************************************************************************/
+
+void comp_io__encode_line(const float * const *planes, int num_planes,
+                          int width, io_byte *line)
+{
+  int c = 0; // Number of pixels already converted by a vector routine
+  if (num_planes == 1)
+    c = encode_flat_sse2(planes[0],line,width);
+  else if ((num_planes == 3) && (cpu_simd_level() >= CPU_SIMD_SSSE3))
+    c = encode_bgr_ssse3(planes[0],planes[1],planes[2],line,width);
+  for (int n=0; n < num_planes; n++)
+    {
+      const float *src = planes[n];
+      io_byte *dst = line + c*num_planes + n;
+      for (int k=c; k < width; k++, dst+=num_planes)
+        *dst = quantize_scalar(src[k]);
+    }
+}
+
+/*****************************************************************************/
+/*                          comp_io__encode_samples                          */
+/*****************************************************************************/
+
+void comp_io__encode_samples(const float *src, int num_samples, io_byte *dst)
+{
+  int c = encode_flat_sse2(src,dst,num_samples);
+  for (; c < num_samples; c++)
+    dst[c] = quantize_scalar(src[c]);
+}
+
+/*****************************************************************************/
+/*                             comp_io__write_bmp                            */
+/*****************************************************************************/
+
+int comp_io__write_bmp(bmp_out *out, const my_aligned_image_comp *comps)
+{
+  int num_comps = out->num_components;
+  const int block_lines = 64; // Lines passed to each `bmp_out__put_lines'
+  io_byte *block = new io_byte[((size_t) out->line_bytes) * block_lines];
+  const float *planes[3];
+  int err_code = 0;
+  int r_step = (out->top_down)?1:-1;
+  while (out->num_unwritten_rows > 0)
+    {
+      int r = file_line_to_row(out->rows-out->num_unwritten_rows,out->rows,
+                               out->top_down);
+      int num_lines = out->num_unwritten_rows;
+      if (num_lines > block_lines)
+        num_lines = block_lines;
+      long long start = io_stats__start(out->stats);
+      io_byte *line = block;
+      for (int k=0; k < num_lines; k++, r+=r_step, line+=out->line_bytes)
+        {
+          for (int n=0; n < num_comps; n++)
+            planes[n] = comps[n].buf + r*comps[n].stride;
+          comp_io__encode_line(planes,num_comps,out->cols,line);
+        }
+      io_stats__add_convert(out->stats,start);
+      if ((err_code = bmp_out__put_lines(out,block,num_lines)) != 0)
+        break;
+    }
+  delete[] block;
+  return err_code;
+}
+
+/*****************************************************************************/
+/*                       comp_io__write_bmp_interleaved                      */
+/*****************************************************************************/
+
+int comp_io__write_bmp_interleaved(bmp_out *out, const float *buf)
+{
+  const int block_lines = 64; // Lines passed to each `bmp_out__put_lines'
+  io_byte *block = new io_byte[((size_t) out->line_bytes) * block_lines];
+  int err_code = 0;
+  int r_step = (out->top_down)?1:-1;
+  while (out->num_unwritten_rows > 0)
+    {
+      int r = file_line_to_row(out->rows-out->num_unwritten_rows,out->rows,
+                               out->top_down);
+      int num_lines = out->num_unwritten_rows;
+      if (num_lines > block_lines)
+        num_lines = block_lines;
+      long long start = io_stats__start(out->stats);
+      io_byte *line = block;
+      for (int k=0; k < num_lines; k++, r+=r_step, line+=out->line_bytes)
+        comp_io__encode_samples(buf + ((size_t) r)*out->line_bytes,
+                                out->line_bytes,line);
+      io_stats__add_convert(out->stats,start);
+      if ((err_code = bmp_out__put_lines(out,block,num_lines)) != 0)
+        break;
+    }
+  delete[] block;
+  return err_code;
+}
+
+/*****************************************************************************/
+/*                        comp_io__write_bmp_parallel                        */
+/*****************************************************************************/
+
+int comp_io__write_bmp_parallel(bmp_out *out,
+                                const my_aligned_image_comp *comps,
+                                int num_threads)
+{
+  if ((out->out == NULL) && (out->first_line == NULL))
+    return(IO_ERR_FILE_NOT_OPEN);
+  int num_comps = out->num_components;
+  return write_bmp_stripes(out,num_threads,[&](int r, io_byte *line)
+    {
+      const float *planes[3];
+      for (int n=0; n < num_comps; n++)
+        planes[n] = comps[n].buf + r*comps[n].stride;
+      comp_io__encode_line(planes,num_comps,out->cols,line);
+    });
+}
+
+/*****************************************************************************/
+/*                  comp_io__write_bmp_interleaved_parallel                  */
+/*****************************************************************************/
+
+int comp_io__write_bmp_interleaved_parallel(bmp_out *out, const float *buf,
+                                            int num_threads)
+{
+  if ((out->out == NULL) && (out->first_line == NULL))
+    return(IO_ERR_FILE_NOT_OPEN);
+  return write_bmp_stripes(out,num_threads,[&](int r, io_byte *line)
+    {
+      comp_io__encode_samples(buf + ((size_t) r)*out->line_bytes,
+                              out->line_bytes,line);
+    });
+}
+
+/*****************************************************************************/
+/*                             comp_io__read_raw                             */
+/*****************************************************************************/
+
+int comp_io__read_raw(raw_in *in, my_aligned_image_comp *comps,
+                      int num_threads)
+{
+  if (in->first_sample == NULL)
+    return(IO_ERR_FILE_NOT_OPEN);
+  run_stripes(in->rows,num_threads,[&](int first_row, int lim_row, int /*s*/)
+    {
+      size_t row_bytes = sizeof(float) * (size_t) in->cols;
+      for (int n=0; n < in->num_components; n++)
+        for (int r=first_row; r < lim_row; r++)
+          {
+            memcpy(comps[n].buf + r*comps[n].stride,
+                   raw_in__row_ptr(in,n,r),row_bytes);
+            extend_row_edges(comps+n,r);
+          }
+    });
+  return 0;
+}
+
+/*****************************************************************************/
+/*                            comp_io__write_raw                             */
+/*****************************************************************************/
+
+int comp_io__write_raw(raw_out *out, const my_aligned_image_comp *comps,
+                       int num_threads)
+{
+  if (out->first_sample == NULL)
+    return(IO_ERR_FILE_NOT_OPEN);
+  run_stripes(out->rows,num_threads,[&](int first_row, int lim_row, int /*s*/)
+    {
+      size_t row_bytes = sizeof(float) * (size_t) out->cols;
+      for (int n=0; n < out->num_components; n++)
+        for (int r=first_row; r < lim_row; r++)
+          memcpy(raw_out__row_ptr(out,n,r),
+                 comps[n].buf + r*comps[n].stride,row_bytes);
+    });
+  return 0;
+}
+
+/*****************************************************************************/
+/*                      comp_io__write_raw_interleaved                       */
+/*****************************************************************************/
+
+int comp_io__write_raw_interleaved(raw_out *out, const float *buf,
+                                   int num_threads)
+{
+  if (out->first_sample == NULL)
+    return(IO_ERR_FILE_NOT_OPEN);
+  int num_comps = out->num_components;
+  run_stripes(out->rows,num_threads,[&](int first_row, int lim_row, int /*s*/)
+    {
+      for (int r=first_row; r < lim_row; r++)
+        {
+          const float *line = buf + ((size_t) r)*out->cols*num_comps;
+          for (int n=0; n < num_comps; n++)
+            {
+              float *dst = raw_out__row_ptr(out,n,r);
+              const float *src = line + n;
+              for (int c=0; c < out->cols; c++, src+=num_comps)
+                dst[c] = *src;
+            }
+        }
+    });
+  return 0;
+}
+
+/*****************************************************************************/
+/*                             comp_io__read_pnm                             */
+/*****************************************************************************/
+
+int comp_io__read_pnm(pnm_in *in, my_aligned_image_comp *comps,
+                      int num_threads)
+{
+  if ((in->in == NULL) && (in->first_line == NULL))
+    return(IO_ERR_FILE_NOT_OPEN);
+  std::vector<int> stripe_err(num_threads > 0 ? num_threads : 1, 0);
+  run_stripes(in->rows,num_threads,[&](int first_row, int lim_row, int s)
+    {
+      if (in->first_line != NULL)
+        { // Decode straight out of the mapped file
+          for (int r=first_row; r < lim_row; r++)
+            decode_pnm_line(pnm_in__row_ptr(in,r),in,comps,r);
+          return;
+        }
+      const int block_lines = 64; // Rows fetched by each positional read
+      io_byte *block = new io_byte[((size_t) in->line_bytes) * block_lines];
+      for (int r=first_row; r < lim_row; )
+        {
+          int num_rows = lim_row - r;
+          if (num_rows > block_lines)
+            num_rows = block_lines;
+          if ((stripe_err[s] =
+               pnm_in__read_rows(in,r,num_rows,block)) != 0)
+            break;
+          const io_byte *line = block;
+          for (; num_rows > 0; num_rows--, r++, line+=in->line_bytes)
+            decode_pnm_line(line,in,comps,r);
+        }
+      delete[] block;
+    });
+  for (size_t s=0; s < stripe_err.size(); s++)
+    if (stripe_err[s] != 0)
+      return stripe_err[s];
+  return 0;
+}
+
+/*****************************************************************************/
+/*                             comp_io__write_pnm                            */
+/*****************************************************************************/
+
+int comp_io__write_pnm(pnm_out *out, const my_aligned_image_comp *comps,
+                       int num_threads)
+{
+  int num_comps = out->num_components;
+  return write_pnm_stripes(out,num_threads,0,
+                           [&](int r, io_byte *line, float * /*scratch*/)
+    {
+      const float *planes[3];
+      for (int n=0; n < num_comps; n++)
+        planes[n] = comps[n].buf + r*comps[n].stride;
+      encode_pnm_line(planes,out,line);
+    });
+}
+
+/*****************************************************************************/
+/*                       comp_io__write_pnm_interleaved                      */
+/*****************************************************************************/
+
+int comp_io__write_pnm_interleaved(pnm_out *out, const float *buf,
+                                   int num_threads)
+{
+  int num_comps = out->num_components;
+  size_t line_samples = ((size_t) out->cols) * num_comps;
+  if (num_comps == 1)
+    return write_pnm_stripes(out,num_threads,0,
+                             [&](int r, io_byte *line, float * /*scratch*/)
+      {
+        const float *row = buf + r*line_samples;
+        encode_pnm_line(&row,out,line);
+      });
+  return write_pnm_stripes(out,num_threads,line_samples,
+                           [&](int r, io_byte *line, float *planar)
+    { // Separate the components of the row first, in the stripe's scratch
+      const float *planes[3];
+      const float *src = buf + r*line_samples;
+      for (int n=0; n < num_comps; n++)
+        {
+          float *dst = planar + n*(size_t) out->cols;
+          for (int k=0; k < out->cols; k++)
+            dst[k] = src[k*num_comps+n];
+          planes[n] = dst;
+        }
+      encode_pnm_line(planes,out,line);
+    });
+}
+
+/*****************************************************************************/
+/* STATIC                          load_image                                */
+/*****************************************************************************/
+
+template<class Alloc> static int
+  load_image(const char *fname, int num_threads, Alloc alloc)
+  /* Opens the file named `fname', calls `alloc(num_comps,rows,cols)' for
+     an array of components initialized to suit it, and decodes the file
+     into them, returning 0 or one of the `IO_ERR_...' codes. */
+{
+  int err_code;
+  my_aligned_image_comp *comps;
+  pnm_dump_spec spec;
+  int path_chars = pnm__parse_dump_name(fname,&spec);
+  if (path_chars > 0)
+    { // Headerless dump, decoded exactly like a mapped PGM/PPM file
+      std::string path(fname,(size_t) path_chars);
+      pnm_in in;
+      if ((err_code = pnm_in__open_headerless(&in,path.c_str(),&spec)) == 0)
+        {
+          comps = alloc(in.num_components,in.rows,in.cols);
+          err_code = comp_io__read_pnm(&in,comps,num_threads);
+        }
+      pnm_in__close(&in);
+    }
+  else if (pnm__file_name_matches(fname))
+    {
+      pnm_in in;
+      if ((err_code = pnm_in__open_mapped(&in,fname)) == 0)
+        {
+          comps = alloc(in.num_components,in.rows,in.cols);
+          err_code = comp_io__read_pnm(&in,comps,num_threads);
+        }
+      pnm_in__close(&in);
+    }
+  else if (raw__file_name_matches(fname))
+    {
+      raw_in in;
+      if ((err_code = raw_in__open(&in,fname)) == 0)
+        {
+          comps = alloc(in.num_components,in.rows,in.cols);
+          err_code = comp_io__read_raw(&in,comps,num_threads);
+        }
+      raw_in__close(&in);
+    }
+  else
+    {
+      bmp_in in;
+      if ((err_code = bmp_in__open_mapped(&in,fname)) == 0)
+        {
+          comps = alloc(in.num_components,in.rows,in.cols);
+          err_code = comp_io__read_bmp_parallel(&in,comps,num_threads);
+        }
+      bmp_in__close(&in);
+    }
+  return err_code;
+}
+
+/*****************************************************************************/
+/*                            comp_io__load_image                            */
+/*****************************************************************************/
+
+int comp_io__load_image(const char *fname, int border,
+                        my_aligned_image_comp **comps, int *num_comps,
+                        int num_threads)
+{
+  *comps = NULL;
+  *num_comps = 0;
+  int err_code = load_image(fname,num_threads,[&](int nc, int rows, int cols)
+    {
+      *num_comps = nc;
+      *comps = new my_aligned_image_comp[nc];
+      for (int n=0; n < nc; n++)
+        { // Place each stripe's pages with the worker that will decode it
+          (*comps)[n].init(rows,cols,border);
+          if (numa__num_nodes() > 1)
+            (*comps)[n].first_touch(num_threads);
+        }
+      return *comps;
+    });
+  if ((err_code != 0) && (*comps != NULL))
+    { delete[] *comps;  *comps = NULL;  *num_comps = 0; }
+  return err_code;
+}
+
+/*****************************************************************************/
+/*                         comp_io__load_multi_image                         */
+/*****************************************************************************/
+
+int comp_io__load_multi_image(const char *fname, int border,
+                              my_plane_layout layout, my_multi_image *image,
+                              int num_threads)
+{
+  std::vector<my_aligned_image_comp> aliases;
+  int err_code = load_image(fname,num_threads,[&](int nc, int rows, int cols)
+    {
+      image->init(nc,rows,cols,border,layout);
+      if (numa__num_nodes() > 1)
+        image->first_touch(num_threads);
+      aliases.resize(nc);
+      image->alias_comps(aliases.data());
+      return aliases.data();
+    });
+  if (err_code != 0)
+    *image = my_multi_image();
+  return err_code;
+}
+
+/*****************************************************************************/
+/*                            comp_io__save_image                            */
+/*****************************************************************************/
+
+int comp_io__save_image(const char *fname,
+                        const my_aligned_image_comp *comps, int num_comps,
+                        int num_threads)
+{
+  int err_code;
+  if (pnm__file_name_matches(fname))
+    {
+      pnm_out out;
+      if ((err_code = pnm_out__open_mapped(&out,fname,comps[0].width,
+                                           comps[0].height,num_comps,
+                                           65535)) == 0)
+        err_code = comp_io__write_pnm(&out,comps,num_threads);
+      pnm_out__close(&out);
+    }
+  else if (raw__file_name_matches(fname))
+    {
+      raw_out out;
+      if ((err_code = raw_out__open(&out,fname,comps[0].width,
+                                    comps[0].height,num_comps)) == 0)
+        err_code = comp_io__write_raw(&out,comps,num_threads);
+      raw_out__close(&out);
+    }
+  else
+    {
+      bmp_out out;
+      if ((err_code = bmp_out__open_mapped(&out,fname,comps[0].width,
+                                           comps[0].height,num_comps)) == 0)
+        err_code = comp_io__write_bmp_parallel(&out,comps,num_threads);
+      bmp_out__close(&out);
+    }
+  return err_code;
+}
+
+/*****************************************************************************/
+/*                         comp_io__save_interleaved                         */
+/*****************************************************************************/
+
+int comp_io__save_interleaved(const char *fname, const float *buf,
+                              int width, int height, int num_comps,
+                              int num_threads)
+{
+  int err_code;
+  if (pnm__file_name_matches(fname))
+    {
+      pnm_out out;
+      if ((err_code = pnm_out__open_mapped(&out,fname,width,height,num_comps,
+                                           65535)) == 0)
+        err_code = comp_io__write_pnm_interleaved(&out,buf,num_threads);
+      pnm_out__close(&out);
+    }
+  else if (raw__file_name_matches(fname))
+    {
+      raw_out out;
+      if ((err_code = raw_out__open(&out,fname,width,height,num_comps)) == 0)
+        err_code = comp_io__write_raw_interleaved(&out,buf,num_threads);
+      raw_out__close(&out);
+    }
+  else
+    {
+      bmp_out out;
+      if ((err_code = bmp_out__open_mapped(&out,fname,width,height,
+                                           num_comps)) == 0)
+        err_code = comp_io__write_bmp_interleaved_parallel(&out,buf,
+                                                           num_threads);
+      bmp_out__close(&out);
+    }
+  return err_code;
+}
+
+/*****************************************************************************/
+/*                            comp_io__start_rows                            */
+/*****************************************************************************/
+
+void comp_io__start_rows(comp_io_row_writer *writer, bmp_out *out)
+{
+  writer->out = out;
+  writer->raw = NULL;
+  writer->block_lines = 64;
+  writer->num_buffered = 0;
+  writer->next_row = 0;
+  writer->block = NULL;
+  if (out->first_line == NULL)
+    writer->block =
+      new io_byte[((size_t) out->line_bytes) * writer->block_lines];
+}
+
+/*****************************************************************************/
+/*                          comp_io__start_raw_rows                          */
+/*****************************************************************************/
+
+void comp_io__start_raw_rows(comp_io_row_writer *writer, raw_out *raw)
+{
+  writer->out = NULL;
+  writer->raw = raw;
+  writer->block = NULL;
+  writer->block_lines = writer->num_buffered = 0;
+  writer->next_row = 0;
+}
+
+/*****************************************************************************/
+/*                             comp_io__put_row                              */
+/*****************************************************************************/
+
+int comp_io__put_row(void *writer_ptr, const float *row, int width)
+{
+  comp_io_row_writer *writer = (comp_io_row_writer *) writer_ptr;
+  if (writer->raw != NULL)
+    {
+      raw_out *raw = writer->raw;
+      if ((raw->num_components != 1) || (width != raw->cols))
+        return(IO_ERR_UNSUPPORTED);
+      if (writer->next_row >= raw->rows)
+        return(IO_ERR_FILE_NOT_OPEN);
+      memcpy(raw_out__row_ptr(raw,0,writer->next_row++),row,
+             sizeof(float) * (size_t) width);
+      return 0;
+    }
+  bmp_out *out = writer->out;
+  if ((out->num_components != 1) || (width != out->cols))
+    return(IO_ERR_UNSUPPORTED);
+  long long start = io_stats__start(out->stats);
+  if (out->first_line != NULL)
+    { // Encode straight into the mapped file
+      if (out->num_unwritten_rows <= 0)
+        return(IO_ERR_FILE_NOT_OPEN);
+      out->num_unwritten_rows--;
+      comp_io__encode_samples(row,width,
+                              bmp_out__row_ptr(out,writer->next_row++));
+      io_stats__add_convert(out->stats,start);
+      io_stats__add_rows(out->stats,1);
+      return 0;
+    }
+  comp_io__encode_samples(row,width,writer->block +
+                          writer->num_buffered * (size_t) out->line_bytes);
+  io_stats__add_convert(out->stats,start);
+  if (++writer->num_buffered < writer->block_lines)
+    return 0;
+  int num_lines = writer->num_buffered;
+  writer->num_buffered = 0;
+  return bmp_out__put_lines(out,writer->block,num_lines);
+}
+
+/*****************************************************************************/
+/*                           comp_io__finish_rows                            */
+/*****************************************************************************/
+
+int comp_io__finish_rows(comp_io_row_writer *writer)
+{
+  int err_code = 0;
+  if (writer->num_buffered > 0)
+    err_code = bmp_out__put_lines(writer->out,writer->block,
+                                  writer->num_buffered);
+  delete[] writer->block;
+  writer->block = NULL;
+  writer->num_buffered = 0;
+  return err_code;
+}
@@ -0,0 +1,92 @@
+/*****************************************************************************/
+// File: cpu_features.cpp
+/*****************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include "cpu_features.h"
+#ifdef _MSC_VER
+#  include <intrin.h>
+#endif
+
+static const char *level_names[] = { "sse2", "ssse3", "avx2", "avx512" };
+
+/*****************************************************************************/
+/* STATIC                        detect_level                                */
+/*****************************************************************************/
+
+static int
+  detect_level()
+{
+#ifdef _MSC_VER
+  int regs[4]; // EAX, EBX, ECX, EDX
+  __cpuid(regs,0);
+  int max_leaf = regs[0];
+  if (max_leaf < 1)
+    return CPU_SIMD_SSE2;
+  __cpuid(regs,1);
+  if (!(regs[2] & (1<<9)))
+    return CPU_SIMD_SSE2;
+  bool avx = ((regs[2] & (1<<28)) && (regs[2] & (1<<27))); // AVX, OSXSAVE
+  bool fma = ((regs[2] & (1<<12)) != 0);
+  if (!avx || !fma || (max_leaf < 7))
+    return CPU_SIMD_SSSE3;
+  unsigned long long xcr0 = _xgetbv(0);
+  if ((xcr0 & 0x06) != 0x06) // OS must save the XMM and YMM registers
+    return CPU_SIMD_SSSE3;
+  __cpuidex(regs,7,0);
+  if (!(regs[1] & (1<<5)))
+    return CPU_SIMD_SSSE3;
+  if ((regs[1] & (1<<16)) && ((xcr0 & 0xE0) == 0xE0)) // and opmask, ZMM
+    return CPU_SIMD_AVX512;
+  return CPU_SIMD_AVX2;
+#else
+  __builtin_cpu_init(); // These checks include operating system support
+  if (!__builtin_cpu_supports("ssse3"))
+    return CPU_SIMD_SSE2;
+  if (!(__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")))
+    return CPU_SIMD_SSSE3;
+  if (__builtin_cpu_supports("avx512f"))
+    return CPU_SIMD_AVX512;
+  return CPU_SIMD_AVX2;
+#endif
+}
+
+/*****************************************************************************/
+/* STATIC                        select_level                                */
+/*****************************************************************************/
+
+static int
+  select_level()
+  /* Applies any `MY_SIMD_LEVEL' cap to the detected level. */
+{
+  int level = detect_level();
+  const char *val = getenv("MY_SIMD_LEVEL");
+  if (val == NULL)
+    return level;
+  for (int n=CPU_SIMD_SSE2; n <= CPU_SIMD_AVX512; n++)
+    if ((strcmp(val,level_names[n]) == 0) && (n < level))
+      return n;
+  return level;
+}
+
+/*****************************************************************************/
+/*                               cpu_simd_level                              */
+/*****************************************************************************/
+
+int cpu_simd_level()
+{
+  static const int level = select_level();
+  return level;
+}
+
+/*****************************************************************************/
+/*                             cpu_simd_level_name                           */
+/*****************************************************************************/
+
+const char *cpu_simd_level_name(int level)
+{
+  if ((level < CPU_SIMD_SSE2) || (level > CPU_SIMD_AVX512))
+    return "unknown";
+  return level_names[level];
+}
@@ -0,0 +1,150 @@
+/*****************************************************************************/
+// File: image_scan.cpp
+/*****************************************************************************/
+
+#include <ctype.h>
+#include <string.h>
+#include <algorithm>
+#include <filesystem>
+#include <system_error>
+#include <vector>
+#include "image_scan.h"
+#include "aligned_image_comps.h"
+#include "plane_pool.h"
+#include "thread_stripes.h"
+
+/* ========================================================================= */
+/*                             Internal Functions                            */
+/* ========================================================================= */
+
+/*****************************************************************************/
+/* STATIC                         comp_bytes                                 */
+/*****************************************************************************/
+
+static long long
+  comp_bytes(int height, int width, int border, int num_comps=1)
+  /* Returns the memory occupied by the buffer allocated by
+     `my_aligned_image_comp::init' for the same arguments, with the default
+     alignment, or by `my_multi_image::init' if `num_comps' is given; the
+     latter puts all the components in one buffer, in either layout.  The
+     buffer comes from `plane_pool__take', so its size is rounded up to the
+     pool's size class. */
+{
+  const int align_samples = MY_COMP_ALIGNMENT / (int) sizeof(float);
+  long long stride =
+    (width + 2*border + align_samples-1) & ~(align_samples-1);
+  long long lead = (align_samples - (border & (align_samples-1))) &
+    (align_samples-1);
+  return (long long) plane_pool__block_bytes((size_t)
+    (lead + stride * (height + 2*(long long) border) * num_comps),
+    MY_COMP_ALIGNMENT);
+}
+
+/*****************************************************************************/
+/* STATIC                        scratch_bytes                               */
+/*****************************************************************************/
+
+static long long
+  scratch_bytes(long long num_floats)
+  /* Returns the memory occupied by a buffer of `num_floats' floats which a
+     task takes directly from `plane_pool__take'. */
+{
+  return (long long)
+    plane_pool__block_bytes((size_t) num_floats,MY_COMP_ALIGNMENT);
+}
+
+/*****************************************************************************/
+/* STATIC                       has_bmp_suffix                               */
+/*****************************************************************************/
+
+static bool
+  has_bmp_suffix(const std::string &name)
+{
+  size_t len = name.size();
+  if (len < 4)
+    return false;
+  const char *suffix = name.c_str() + len - 4;
+  return (suffix[0] == '.') && (tolower(suffix[1]) == 'b') &&
+    (tolower(suffix[2]) == 'm') && (tolower(suffix[3]) == 'p');
+}
+
+/*****************************************************************************/
+/*                           image_op__working_set                           */
+/*****************************************************************************/
+
+long long image_op__working_set(image_op op, int width, int height,
+                                int num_components, int border)
+{
+  long long plane = ((long long) width) * height; // In floats
+  long long bytes = comp_bytes(height,width,border,num_components);
+  switch (op) {
+    case IMAGE_OP_LOAD:
+      break;
+    case IMAGE_OP_BILINEAR: // One output row, 3 times as wide
+      bytes += comp_bytes(1,3*width,0);
+      break;
+    case IMAGE_OP_SINC: // Full 3x output plus two rows of intermediates
+      bytes += comp_bytes(3*height,3*width,0);
+      bytes += 2 * scratch_bytes(3 * (long long) width);
+      break;
+    case IMAGE_OP_DIFFERENTIATE: // Output, RGB result and magnitudes
+      bytes += comp_bytes(height,width,0) + scratch_bytes(3*plane) +
+        scratch_bytes(plane);
+      break;
+    case IMAGE_OP_DOG: // As above, plus two separable filter intermediates
+      bytes += comp_bytes(height,width,0) + scratch_bytes(3*plane) +
+        3*scratch_bytes(plane);
+      break;
+  }
+  return bytes;
+}
+
+/*****************************************************************************/
+/*                           image_scan__directory                           */
+/*****************************************************************************/
+
+int image_scan__directory(const char *dir_name, image_op op, int border,
+                          int num_threads, image_scan_entry **entries,
+                          int *num_entries)
+{
+  namespace fs = std::filesystem;
+  *entries = NULL;
+  *num_entries = 0;
+
+  // Listing the directory is cheap next to opening each file, so do it
+  // first, on this thread.
+  std::vector<std::string> paths;
+  std::error_code ec;
+  fs::recursive_directory_iterator it(dir_name,
+    fs::directory_options::skip_permission_denied,ec);
+  if (ec)
+    return(IO_ERR_NO_FILE);
+  for (; it != fs::recursive_directory_iterator(); it.increment(ec))
+    {
+      if (ec)
+        break; // Report whatever was found before the failure
+      if (it->is_regular_file(ec) && has_bmp_suffix(it->path().string()))
+        paths.push_back(it->path().string());
+    }
+  std::sort(paths.begin(),paths.end());
+
+  int count = (int) paths.size();
+  image_scan_entry *list = new image_scan_entry[count];
+  run_stripes(count,num_threads,[&](int first, int lim, int)
+    {
+      for (int n=first; n < lim; n++)
+        {
+          image_scan_entry *entry = list + n;
+          entry->path = paths[n];
+          entry->working_set_bytes = 0;
+          entry->err_code = bmp_in__probe(&entry->info,entry->path.c_str());
+          if (entry->err_code == 0)
+            entry->working_set_bytes =
+              image_op__working_set(op,entry->info.cols,entry->info.rows,
+                                    entry->info.num_components,border);
+        }
+    });
+  *entries = list;
+  *num_entries = count;
+  return 0;
+}
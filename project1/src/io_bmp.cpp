@@ -7,7 +7,11 @@
 /*****************************************************************************/
 
 #include <string.h>  // Import `memset' function
+#include <mutex>
+#include <thread>
+#include <condition_variable>
 #include "io_bmp.h"
+#include "io_stats.h"
 
 /* ========================================================================= */
 /*                             Internal Functions                            */
@@ -45,71 +49,580 @@ static inline void
   to_little_endian(words,num_words);
 }
 
+/*****************************************************************************/
+/* STATIC                        get_scratch                                 */
+/*****************************************************************************/
 
-/* ========================================================================= */
-/*                                   bmp_in                                  */
-/* ========================================================================= */
+static io_byte *
+  get_scratch(io_byte **scratch, size_t *scratch_bytes, size_t min_bytes)
+  /* Returns a buffer of at least `min_bytes', growing the one recorded by
+     `*scratch' if necessary.  Returns NULL if memory is exhausted. */
+{
+  if (*scratch_bytes < min_bytes)
+    {
+      free(*scratch);
+      *scratch_bytes = 0;
+      if ((*scratch = (io_byte *) malloc(min_bytes)) != NULL)
+        *scratch_bytes = min_bytes;
+    }
+  return *scratch;
+}
 
 /*****************************************************************************/
-/*                                bmp_in__open                               */
+/* STATIC                        counted_fread                               */
 /*****************************************************************************/
 
-int bmp_in__open(bmp_in *state, const char *fname)
+static size_t
+  counted_fread(void *buf, size_t num_bytes, FILE *fp, io_stats *stats)
+  /* Same as `fread(buf,1,num_bytes,fp)', but recorded in `stats' (if
+     non-NULL). */
 {
-  memset(state,0,sizeof(bmp_in)); // Start by reseting everything
-  if ((state->in = fopen(fname,"rb")) == NULL)
-    return(IO_ERR_NO_FILE);
+  long long start = io_stats__start(stats);
+  size_t result = fread(buf,1,num_bytes,fp);
+  io_stats__add_io(stats,(long long) result,start);
+  return result;
+}
 
-  io_byte magic[14];
-  bmp_header header;
-  fread(magic,1,14,state->in);
+/*****************************************************************************/
+/* STATIC                        counted_fwrite                              */
+/*****************************************************************************/
+
+static size_t
+  counted_fwrite(const void *buf, size_t num_bytes, FILE *fp,
+                 io_stats *stats)
+  /* Same as `fwrite(buf,1,num_bytes,fp)', but recorded in `stats' (if
+     non-NULL). */
+{
+  long long start = io_stats__start(stats);
+  size_t result = fwrite(buf,1,num_bytes,fp);
+  io_stats__add_io(stats,(long long) result,start);
+  return result;
+}
+
+/*****************************************************************************/
+/* STATIC                      parse_in_header                               */
+/*****************************************************************************/
+
+static int
+  parse_in_header(bmp_in *state, io_byte magic[], bmp_header *header,
+                  int *palette_bytes, int *offset)
+  /* Interprets the 14 byte `magic' field and the 40 byte `header' (still in
+     file byte order), filling in the dimensions of `state'.  On success,
+     `*palette_bytes' holds the size of the colour table which follows the
+     header and `*offset' holds the location of the first line of sample
+     data, relative to the start of the file. */
+{
   if ((magic[0] != 'B') || (magic[1] != 'M'))
     return(IO_ERR_FILE_HEADER);
-  if (fread(&header,1,40,state->in) != 40)
-    return(IO_ERR_FILE_TRUNC);
-
-  from_little_endian((io_int32 *) &header,10);
-  state->cols = header.width;
-  state->rows = header.height;
-  int bit_count = (header.planes_bits>>16);
-  if (bit_count == 24)
-    state->num_components = 3;
-  else if (bit_count == 8)
-    state->num_components = 1;
+  from_little_endian((io_int32 *) header,10);
+  state->cols = header->width;
+  state->rows = header->height;
+  if (state->rows < 0)
+    { // Negative height means the lines are stored from top to bottom
+      state->rows = -state->rows;
+      state->top_down = 1;
+    }
+  int bit_count = (header->planes_bits>>16);
+  io_uint32 compression = header->compression;
+  if ((bit_count == 24) && (compression == BMP_COMPRESSION_NONE))
+    state->num_components = state->pixel_bytes = 3;
+  else if ((bit_count == 8) && ((compression == BMP_COMPRESSION_NONE) ||
+                                (compression == BMP_COMPRESSION_RLE8)))
+    state->num_components = state->pixel_bytes = 1;
+  else if ((bit_count == 32) && ((compression == BMP_COMPRESSION_NONE) ||
+                                 (compression == BMP_COMPRESSION_BITFIELDS)))
+    { state->num_components = 3;  state->pixel_bytes = 4; }
   else
     return(IO_ERR_UNSUPPORTED);
-  int palette_entries_used = header.num_colours_used;
+  int palette_entries_used = header->num_colours_used;
   if (state->num_components != 1)
     palette_entries_used = 0;
-  else if (header.num_colours_used == 0)
+  else if (header->num_colours_used == 0)
     palette_entries_used = (1<<bit_count);
   int header_size = 54 + 4*palette_entries_used;
+  if (compression == BMP_COMPRESSION_BITFIELDS)
+    header_size += 12; // Colour masks
 
-  int offset = magic[13];
-  offset <<= 8; offset += magic[12];
-  offset <<= 8; offset += magic[11];
-  offset <<= 8; offset += magic[10];
-  if (offset < header_size)
+  *offset = magic[13];
+  *offset <<= 8; *offset += magic[12];
+  *offset <<= 8; *offset += magic[11];
+  *offset <<= 8; *offset += magic[10];
+  if (*offset < header_size)
     return(IO_ERR_FILE_HEADER);
-  if (palette_entries_used)
-    fseek(state->in,palette_entries_used*4,SEEK_CUR); // Skip over palette
-  if (offset > header_size)
-    fseek(state->in,offset-header_size,SEEK_CUR);
+  state->data_offset = *offset;
+  *palette_bytes = 4*palette_entries_used;
   state->num_unread_rows = state->rows;
-  state->line_bytes = state->num_components * state->cols;
+  state->line_bytes = state->pixel_bytes * state->cols;
   state->alignment_bytes =
     (4-state->line_bytes) & 3; // Pad to a multiple of 4 bytes
   return 0;
 }
 
+/*****************************************************************************/
+/* STATIC                       check_bitfields                              */
+/*****************************************************************************/
+
+static int
+  check_bitfields(const io_byte masks[])
+  /* Checks the 12 bytes of red, green and blue masks which follow the
+     header of a `BMP_COMPRESSION_BITFIELDS' file, returning 0 if they
+     describe ordinary BGRA pixels, or `IO_ERR_UNSUPPORTED' otherwise. */
+{
+  static const io_byte standard[12] =
+    { 0x00,0x00,0xFF,0x00,  0x00,0xFF,0x00,0x00,  0xFF,0x00,0x00,0x00 };
+  return (memcmp(masks,standard,12) == 0)?0:IO_ERR_UNSUPPORTED;
+}
+
+/*****************************************************************************/
+/* STATIC                         expand_rle8                                */
+/*****************************************************************************/
+
+static int
+  expand_rle8(bmp_in *state, const io_byte *src, size_t src_bytes)
+  /* Expands the `src_bytes' bytes of RLE8 data found at `src' into a new
+     `state->expanded' buffer, which then takes the place of a mapped file
+     through `state->first_line'.  Lines are kept in file order, with no
+     padding, and pixels skipped by delta codes (or not coded at all) are
+     left as 0.  Runs which would overflow a line are clipped to it.
+     Returns 0, or `IO_ERR_FILE_TRUNC' if the data ends before the last
+     line has been completed and without an end-of-bitmap code. */
+{
+  int cols = state->cols, rows = state->rows;
+  size_t total_bytes = ((size_t) cols) * (size_t) rows;
+  if ((state->expanded = (io_byte *) calloc(total_bytes,1)) == NULL)
+    return(IO_ERR_FILE_TRUNC);
+  state->alignment_bytes = 0;
+  state->first_line = state->expanded;
+  const io_byte *end = src + src_bytes;
+  int x = 0, y = 0; // Position within the expanded image, in file order
+  while ((src+2) <= end)
+    {
+      int count = src[0], value = src[1];
+      src += 2;
+      if (y >= rows)
+        return 0; // Ignore anything beyond the last line
+      io_byte *dst = state->expanded + ((size_t) y)*(size_t) cols;
+      if (count > 0)
+        { // Encoded mode: `count' copies of `value'
+          if (count > (cols-x))
+            count = cols-x;
+          memset(dst+x,value,(size_t) count);
+          x += count;
+        }
+      else if (value == 0)
+        { x = 0;  y++; } // End of line
+      else if (value == 1)
+        return 0; // End of bitmap
+      else if (value == 2)
+        { // Delta: move right and up (in file order) by the next two bytes
+          if ((src+2) > end)
+            break;
+          x += src[0];  y += src[1];  src += 2;
+          if (x > cols)
+            x = cols;
+        }
+      else
+        { // Absolute mode: `value' literal bytes, padded to an even length
+          int padded = (value+1) & ~1;
+          if ((src+padded) > end)
+            break;
+          count = (value > (cols-x))?(cols-x):value;
+          memcpy(dst+x,src,(size_t) count);
+          x += count;  src += padded;
+        }
+    }
+  return (y >= rows)?0:IO_ERR_FILE_TRUNC;
+}
+
+
+/*****************************************************************************/
+/* STATIC                      read_stream_lines                             */
+/*****************************************************************************/
+
+static int
+  read_stream_lines(bmp_in *state, io_byte *buf, int num_lines,
+                    io_byte **scratch, size_t *scratch_bytes)
+  /* Reads `num_lines' padded lines from `state->in' with a single `fread',
+     stripping the padding in memory; the padded lines are read into
+     `*scratch', which is grown with `get_scratch' if need be.  Does not
+     touch `state->num_unread_rows'. */
+{
+  size_t line_bytes = (size_t) state->line_bytes;
+  size_t padded_bytes = line_bytes + (size_t) state->alignment_bytes;
+  size_t total_bytes = padded_bytes * (size_t) num_lines;
+  if (state->alignment_bytes == 0)
+    { // Lines are contiguous in the file, so read straight into `buf'
+      if (counted_fread(buf,total_bytes,state->in,state->stats) !=
+          total_bytes)
+        return(IO_ERR_FILE_TRUNC);
+      return 0;
+    }
+  io_byte *src = get_scratch(scratch,scratch_bytes,total_bytes);
+  if (src == NULL)
+    { // Fall back to reading one line at a time
+      io_byte pad[3];
+      for (; num_lines > 0; num_lines--, buf+=line_bytes)
+        if ((counted_fread(buf,line_bytes,state->in,state->stats) !=
+             line_bytes) ||
+            (counted_fread(pad,(size_t) state->alignment_bytes,state->in,
+                           state->stats) != (size_t) state->alignment_bytes))
+          return(IO_ERR_FILE_TRUNC);
+      return 0;
+    }
+  if (counted_fread(src,total_bytes,state->in,state->stats) != total_bytes)
+    return(IO_ERR_FILE_TRUNC);
+  for (; num_lines > 0; num_lines--, buf+=line_bytes, src+=padded_bytes)
+    memcpy(buf,src,line_bytes);
+  return 0;
+}
+
+/*****************************************************************************/
+/* STRUCT                        bmp_prefetch                                */
+/*****************************************************************************/
+
+struct bmp_prefetch {
+    int block_lines; // Lines in each block of the ring
+    int num_blocks;
+    io_byte *blocks; // `num_blocks' consecutive blocks of unpadded lines
+    io_byte *scratch; // The reader thread's own `read_stream_lines' buffer
+    size_t scratch_bytes;
+    int *block_fill; // Lines in each block; 0 if the block is free
+    int *block_err; // Error code with which each block was completed
+    int head; // Next block the consumer will take lines from
+    int head_pos; // Lines already taken from block `head'
+    int tail; // Next block the reader thread will fill
+    bool stop;
+    std::mutex mutex;
+    std::condition_variable filled; // Signalled by the reader thread
+    std::condition_variable freed; // Signalled by the consumer
+    std::thread thread;
+  };
+
+/*****************************************************************************/
+/* STATIC                       prefetch_thread                              */
+/*****************************************************************************/
+
+static void
+  prefetch_thread(bmp_in *state, int lines_to_read)
+{
+  bmp_prefetch *pf = state->prefetch;
+  size_t block_bytes = ((size_t) pf->block_lines) * (size_t) state->line_bytes;
+  while (lines_to_read > 0)
+    {
+      int idx;
+      { // Wait for the consumer to release the next block
+        std::unique_lock<std::mutex> lock(pf->mutex);
+        pf->freed.wait(lock,[&]{ return pf->stop ||
+                                        (pf->block_fill[pf->tail] == 0); });
+        if (pf->stop)
+          return;
+        idx = pf->tail;
+      }
+      int num_lines = (lines_to_read < pf->block_lines)?
+        lines_to_read:pf->block_lines;
+      int err_code = read_stream_lines(state,pf->blocks+idx*block_bytes,
+                                       num_lines,&pf->scratch,
+                                       &pf->scratch_bytes);
+      lines_to_read -= num_lines;
+      {
+        std::lock_guard<std::mutex> lock(pf->mutex);
+        pf->block_err[idx] = err_code;
+        pf->block_fill[idx] = num_lines;
+        pf->tail = (idx+1) % pf->num_blocks;
+      }
+      pf->filled.notify_one();
+      if (err_code != 0)
+        return;
+    }
+}
+
+/*****************************************************************************/
+/* STATIC                       take_prefetched                              */
+/*****************************************************************************/
+
+static int
+  take_prefetched(bmp_in *state, io_byte *buf, int num_lines)
+  /* Consumer side of the prefetch ring, used by `bmp_in__get_line' and
+     `bmp_in__get_lines'.  The caller has already checked that `num_lines'
+     lines remain. */
+{
+  bmp_prefetch *pf = state->prefetch;
+  size_t line_bytes = (size_t) state->line_bytes;
+  size_t block_bytes = ((size_t) pf->block_lines) * line_bytes;
+  state->num_unread_rows -= num_lines;
+  io_stats__add_rows(state->stats,num_lines);
+  while (num_lines > 0)
+    {
+      int idx = pf->head, fill, err_code;
+      {
+        long long start = io_stats__start(state->stats);
+        std::unique_lock<std::mutex> lock(pf->mutex);
+        pf->filled.wait(lock,[&]{ return pf->block_fill[idx] != 0; });
+        fill = pf->block_fill[idx];  err_code = pf->block_err[idx];
+        io_stats__add_wait(state->stats,start);
+      }
+      if (err_code != 0)
+        return err_code;
+      int n = fill - pf->head_pos;
+      if (n > num_lines)
+        n = num_lines;
+      memcpy(buf,pf->blocks + idx*block_bytes + pf->head_pos*line_bytes,
+             n*line_bytes);
+      buf += n*line_bytes;  num_lines -= n;  pf->head_pos += n;
+      if (pf->head_pos == fill)
+        { // Hand the block back to the reader thread
+          {
+            std::lock_guard<std::mutex> lock(pf->mutex);
+            pf->block_fill[idx] = 0;
+          }
+          pf->freed.notify_one();
+          pf->head = (idx+1) % pf->num_blocks;  pf->head_pos = 0;
+        }
+    }
+  return 0;
+}
+
+/*****************************************************************************/
+/* STATIC                        stop_prefetch                               */
+/*****************************************************************************/
+
+static void
+  stop_prefetch(bmp_in *state)
+{
+  bmp_prefetch *pf = state->prefetch;
+  {
+    std::lock_guard<std::mutex> lock(pf->mutex);
+    pf->stop = true;
+  }
+  pf->freed.notify_one();
+  pf->thread.join();
+  delete[] pf->blocks;
+  delete[] pf->block_fill;
+  delete[] pf->block_err;
+  free(pf->scratch);
+  delete pf;
+  state->prefetch = NULL;
+}
+
+
+/* ========================================================================= */
+/*                                   bmp_in                                  */
+/* ========================================================================= */
+
+/*****************************************************************************/
+/* STATIC                          open_stream_in                            */
+/*****************************************************************************/
+
+static int open_stream_in(bmp_in *state, const char *fname)
+  /* Implements `bmp_in__open', which releases whatever this function
+     managed to acquire if it returns an error code. */
+{
+  memset(state,0,sizeof(bmp_in)); // Start by reseting everything
+  state->stats = io_stats__create(fname,false);
+  if ((state->in = fopen(fname,"rb")) == NULL)
+    return(IO_ERR_NO_FILE);
+
+  io_byte magic[14];
+  bmp_header header;
+  counted_fread(magic,14,state->in,state->stats);
+  if ((magic[0] != 'B') || (magic[1] != 'M'))
+    return(IO_ERR_FILE_HEADER);
+  if (counted_fread(&header,40,state->in,state->stats) != 40)
+    return(IO_ERR_FILE_TRUNC);
+
+  int err_code, palette_bytes, offset;
+  if ((err_code = parse_in_header(state,magic,&header,
+                                  &palette_bytes,&offset)) != 0)
+    return err_code;
+  if (header.compression == BMP_COMPRESSION_BITFIELDS)
+    {
+      io_byte masks[12];
+      if (counted_fread(masks,12,state->in,state->stats) != 12)
+        return(IO_ERR_FILE_TRUNC);
+      if ((err_code = check_bitfields(masks)) != 0)
+        return err_code;
+      if (offset > 66)
+        fseek(state->in,offset-66,SEEK_CUR);
+      return 0;
+    }
+  if (header.compression == BMP_COMPRESSION_RLE8)
+    { // Expand the whole image now, since lines have no fixed location
+      fseek(state->in,0,SEEK_END);
+      long file_bytes = ftell(state->in);
+      if (file_bytes < (long) offset)
+        return(IO_ERR_FILE_TRUNC);
+      size_t src_bytes = (size_t)(file_bytes - offset);
+      io_byte *src = (io_byte *) malloc((src_bytes > 0)?src_bytes:1);
+      if (src == NULL)
+        return(IO_ERR_FILE_TRUNC);
+      fseek(state->in,offset,SEEK_SET);
+      if (counted_fread(src,src_bytes,state->in,state->stats) != src_bytes)
+        err_code = IO_ERR_FILE_TRUNC;
+      else
+        err_code = expand_rle8(state,src,src_bytes);
+      free(src);
+      fclose(state->in);
+      state->in = NULL;
+      return err_code;
+    }
+  if (palette_bytes)
+    fseek(state->in,palette_bytes,SEEK_CUR); // Skip over palette
+  if (offset > (54+palette_bytes))
+    fseek(state->in,offset-(54+palette_bytes),SEEK_CUR);
+  return 0;
+}
+
+/*****************************************************************************/
+/*                                bmp_in__open                               */
+/*****************************************************************************/
+
+int bmp_in__open(bmp_in *state, const char *fname)
+{
+  int err_code = open_stream_in(state,fname);
+  if (err_code != 0)
+    bmp_in__close(state); // Closes the file and frees the I/O statistics
+  return err_code;
+}
+
+/*****************************************************************************/
+/*                               bmp_in__probe                               */
+/*****************************************************************************/
+
+int bmp_in__probe(bmp_info *info, const char *fname)
+{
+  memset(info,0,sizeof(bmp_info));
+  FILE *fp = fopen(fname,"rb");
+  if (fp == NULL)
+    return(IO_ERR_NO_FILE);
+  io_byte head[54];
+  int err_code = IO_ERR_FILE_TRUNC;
+  if (io_file__pread(fp,head,54,0) == 0)
+    {
+      bmp_in state;
+      memset(&state,0,sizeof(bmp_in));
+      bmp_header header;
+      memcpy(&header,head+14,40);
+      int palette_bytes, offset;
+      if ((err_code = parse_in_header(&state,head,&header,
+                                      &palette_bytes,&offset)) == 0)
+        {
+          info->num_components = state.num_components;
+          info->rows = state.rows;
+          info->cols = state.cols;
+          info->top_down = state.top_down;
+          info->data_offset = state.data_offset;
+        }
+    }
+  fclose(fp);
+  return err_code;
+}
+
+/*****************************************************************************/
+/* STATIC                          open_mapped_in                            */
+/*****************************************************************************/
+
+static int open_mapped_in(bmp_in *state, const char *fname)
+  /* Implements `bmp_in__open_mapped' in the same way as `open_stream_in'. */
+{
+  memset(state,0,sizeof(bmp_in)); // Start by reseting everything
+  state->stats = io_stats__create(fname,true);
+  if (io_mapping__open_read(&state->map,fname) != 0)
+    return(IO_ERR_NO_FILE);
+  if (state->map.bytes < 54)
+    return(IO_ERR_FILE_TRUNC);
+
+  io_byte magic[14];
+  bmp_header header;
+  memcpy(magic,state->map.base,14);
+  memcpy(&header,state->map.base+14,40);
+  int err_code, palette_bytes, offset;
+  if ((err_code = parse_in_header(state,magic,&header,
+                                  &palette_bytes,&offset)) != 0)
+    return err_code;
+  if (state->map.bytes < (size_t) offset)
+    return(IO_ERR_FILE_TRUNC);
+  if ((header.compression == BMP_COMPRESSION_BITFIELDS) &&
+      ((err_code = check_bitfields(state->map.base+54)) != 0))
+    return err_code; // `parse_in_header' ensured that `offset' >= 66
+  if (header.compression == BMP_COMPRESSION_RLE8)
+    {
+      if (state->stats != NULL)
+        state->stats->bytes += (long long) state->map.bytes;
+      err_code = expand_rle8(state,state->map.base+offset,
+                             state->map.bytes-(size_t) offset);
+      io_mapping__close(&state->map); // No longer needed
+      return err_code;
+    }
+  size_t data_bytes = ((size_t)(state->line_bytes+state->alignment_bytes)) *
+    (size_t) state->rows;
+  if ((state->map.bytes - (size_t) offset) < data_bytes)
+    return(IO_ERR_FILE_TRUNC);
+  state->first_line = state->map.base + offset;
+  if (state->stats != NULL)
+    state->stats->bytes += (long long) state->map.bytes; // Reads on demand
+  return 0;
+}
+
+/*****************************************************************************/
+/*                            bmp_in__open_mapped                            */
+/*****************************************************************************/
+
+int bmp_in__open_mapped(bmp_in *state, const char *fname)
+{
+  int err_code = open_mapped_in(state,fname);
+  if (err_code != 0)
+    bmp_in__close(state); // Unmaps the file and frees the I/O statistics
+  return err_code;
+}
+
+/*****************************************************************************/
+/*                           bmp_in__start_prefetch                          */
+/*****************************************************************************/
+
+int bmp_in__start_prefetch(bmp_in *state, int block_lines, int num_blocks)
+{
+  if (state->first_line != NULL)
+    return 0; // The OS is already reading ahead into the mapping
+  if ((state->in == NULL) || (state->prefetch != NULL))
+    return(IO_ERR_FILE_NOT_OPEN);
+  if (state->num_unread_rows <= 0)
+    return 0;
+  if (block_lines < 1)
+    block_lines = 1;
+  if (num_blocks < 2)
+    num_blocks = 2;
+  bmp_prefetch *pf = new bmp_prefetch;
+  pf->block_lines = block_lines;
+  pf->num_blocks = num_blocks;
+  pf->blocks = new io_byte[((size_t) num_blocks) * (size_t) block_lines *
+                           (size_t) state->line_bytes];
+  pf->block_fill = new int[num_blocks];
+  pf->block_err = new int[num_blocks];
+  for (int b=0; b < num_blocks; b++)
+    pf->block_fill[b] = pf->block_err[b] = 0;
+  pf->scratch = NULL;
+  pf->scratch_bytes = 0;
+  pf->head = pf->head_pos = pf->tail = 0;
+  pf->stop = false;
+  state->prefetch = pf;
+  pf->thread = std::thread(prefetch_thread,state,state->num_unread_rows);
+  return 0;
+}
+
 /*****************************************************************************/
 /*                                bmp_in__close                              */
 /*****************************************************************************/
 
 void bmp_in__close(bmp_in *state)
 {
+  if (state->prefetch != NULL)
+    stop_prefetch(state);
   if (state->in != NULL)
     fclose(state->in);
+  io_mapping__close(&state->map);
+  free(state->scratch);
+  free(state->expanded);
+  io_stats__close(state->stats,"read");
   memset(state,0,sizeof(bmp_in));
 }
 
@@ -119,37 +632,172 @@ void bmp_in__close(bmp_in *state)
 
 int bmp_in__get_line(bmp_in *state, io_byte *line)
 {
+  if (state->first_line != NULL)
+    {
+      const io_byte *src = bmp_in__next_line_ptr(state);
+      if (src == NULL)
+        return(IO_ERR_FILE_NOT_OPEN);
+      memcpy(line,src,(size_t) state->line_bytes);
+      return 0;
+    }
   if ((state->in == NULL) || (state->num_unread_rows <= 0))
     return(IO_ERR_FILE_NOT_OPEN);
+  if (state->prefetch != NULL)
+    return take_prefetched(state,line,1);
   state->num_unread_rows--;
-  if (fread(line,1,(size_t) state->line_bytes,state->in) !=
+  io_stats__add_rows(state->stats,1);
+  if (counted_fread(line,(size_t) state->line_bytes,state->in,
+                    state->stats) !=
       (size_t) state->line_bytes)
     return(IO_ERR_FILE_TRUNC);
   if (state->alignment_bytes > 0)
     {
       io_byte buf[3];
-      fread(buf,1,(size_t) state->alignment_bytes,state->in);
+      counted_fread(buf,(size_t) state->alignment_bytes,state->in,
+                    state->stats);
+    }
+  return 0;
+}
+
+/*****************************************************************************/
+/*                              bmp_in__get_lines                            */
+/*****************************************************************************/
+
+int bmp_in__get_lines(bmp_in *state, io_byte *buf, int num_lines)
+{
+  if (((state->in == NULL) && (state->first_line == NULL)) ||
+      (num_lines > state->num_unread_rows))
+    return(IO_ERR_FILE_NOT_OPEN);
+  if (state->first_line != NULL)
+    {
+      size_t line_bytes = (size_t) state->line_bytes;
+      for (; num_lines > 0; num_lines--, buf+=line_bytes)
+        memcpy(buf,bmp_in__next_line_ptr(state),line_bytes);
+      return 0;
+    }
+  if (state->prefetch != NULL)
+    return take_prefetched(state,buf,num_lines);
+  state->num_unread_rows -= num_lines;
+  io_stats__add_rows(state->stats,num_lines);
+  return read_stream_lines(state,buf,num_lines,&state->scratch,
+                           &state->scratch_bytes);
+}
+
+/*****************************************************************************/
+/*                              bmp_in__read_rows                            */
+/*****************************************************************************/
+
+int bmp_in__read_rows(bmp_in *state, int first_row, int num_rows,
+                      io_byte *buf)
+{
+  if ((state->in == NULL) && (state->first_line == NULL))
+    return(IO_ERR_FILE_NOT_OPEN);
+  if ((first_row < 0) || (num_rows < 0) ||
+      (num_rows > (state->rows - first_row)))
+    return(IO_ERR_FILE_NOT_OPEN);
+  if (num_rows == 0)
+    return 0;
+  io_stats__add_rows(state->stats,num_rows);
+  size_t line_bytes = (size_t) state->line_bytes;
+  size_t padded_bytes = line_bytes + (size_t) state->alignment_bytes;
+  if (state->first_line != NULL)
+    {
+      for (int r=first_row; num_rows > 0; num_rows--, r++, buf+=line_bytes)
+        memcpy(buf,bmp_in__row_ptr(state,r),line_bytes);
+      return 0;
+    }
+
+  // The requested rows occupy one contiguous run of lines in the file,
+  // starting from `first_row' for a top-down file, or from the last of the
+  // rows for a bottom-up file.
+  int first_idx = (state->top_down)?first_row:
+    (state->rows - first_row - num_rows);
+  long long offset = state->data_offset +
+    ((long long) first_idx) * (long long) padded_bytes;
+  size_t total_bytes = padded_bytes * (size_t) num_rows;
+  long long start = io_stats__start(state->stats);
+  if (state->top_down && (state->alignment_bytes == 0))
+    {
+      if (io_file__pread(state->in,buf,total_bytes,offset) != 0)
+        return(IO_ERR_FILE_TRUNC);
+      io_stats__add_io(state->stats,(long long) total_bytes,start);
+      return 0;
+    }
+  io_byte *src = (io_byte *) malloc(total_bytes); // Private to this call
+  if (src == NULL)
+    return(IO_ERR_FILE_TRUNC);
+  if (io_file__pread(state->in,src,total_bytes,offset) != 0)
+    {
+      free(src);
+      return(IO_ERR_FILE_TRUNC);
     }
+  io_stats__add_io(state->stats,(long long) total_bytes,start);
+  if (state->top_down)
+    {
+      io_byte *sp = src;
+      for (; num_rows > 0; num_rows--, buf+=line_bytes, sp+=padded_bytes)
+        memcpy(buf,sp,line_bytes);
+    }
+  else
+    { // Lines come out of the file in reverse order
+      io_byte *sp = src + (num_rows-1)*padded_bytes;
+      for (; num_rows > 0; num_rows--, buf+=line_bytes, sp-=padded_bytes)
+        memcpy(buf,sp,line_bytes);
+    }
+  free(src);
   return 0;
 }
 
+/*****************************************************************************/
+/*                           bmp_in__next_line_ptr                           */
+/*****************************************************************************/
+
+const io_byte *bmp_in__next_line_ptr(bmp_in *state)
+{
+  if ((state->first_line == NULL) || (state->num_unread_rows <= 0))
+    return NULL;
+  int idx = state->rows - state->num_unread_rows; // Index in file order
+  state->num_unread_rows--;
+  io_stats__add_rows(state->stats,1);
+  return state->first_line +
+    ((size_t) idx) * (size_t)(state->line_bytes+state->alignment_bytes);
+}
+
+/*****************************************************************************/
+/*                              bmp_in__row_ptr                              */
+/*****************************************************************************/
+
+const io_byte *bmp_in__row_ptr(bmp_in *state, int r)
+{
+  if ((state->first_line == NULL) || (r < 0) || (r >= state->rows))
+    return NULL;
+  int idx = (state->top_down)?r:(state->rows-1-r);
+  return state->first_line +
+    ((size_t) idx) * (size_t)(state->line_bytes+state->alignment_bytes);
+}
+
 
 /* ========================================================================= */
 /*                                  bmp_out                                  */
 /* ========================================================================= */
 
 /*****************************************************************************/
-/*                               bmp_out__open                             */
+/* STATIC                           open_out                                 */
 /*****************************************************************************/
 
-int bmp_out__open(bmp_out *state, const char *fname,
-                  int width, int height, int num_components)
+static int
+  open_out(bmp_out *state, const char *fname, int width, int height,
+           int num_components, int top_down, int mapped)
+  /* Implements `bmp_out__open', `bmp_out__open_top_down' and
+     `bmp_out__open_mapped'. */
 {
   memset(state,0,sizeof(bmp_out)); // Start by reseting everything
   state->num_components = num_components;
   state->rows = state->num_unwritten_rows = height;
   state->cols = width;
-  io_byte magic[14];
+  state->top_down = top_down;
+  io_byte head[54+1024]; // Magic field, header and (optional) colour LUT
+  io_byte *magic = head;
   bmp_header header;
   int header_bytes = 14+sizeof(header);
   assert(header_bytes == 54);
@@ -159,6 +807,7 @@ int bmp_out__open(bmp_out *state, const char *fname,
     return(IO_ERR_UNSUPPORTED);
   state->line_bytes = num_components * width;
   state->alignment_bytes = (4-state->line_bytes) & 3;
+  state->data_offset = header_bytes;
   int file_bytes = header_bytes +
     (state->line_bytes+state->alignment_bytes)*state->rows;
   magic[0] = 'B'; magic[1] = 'M';
@@ -173,7 +822,7 @@ int bmp_out__open(bmp_out *state, const char *fname,
   magic[13] = (io_byte)(header_bytes>>24);
   header.size = 40;
   header.width = width;
-  header.height = height;
+  header.height = (top_down)?-height:height;
   header.planes_bits = 1; // Set `planes'=1 (mandatory)
   header.planes_bits |= ((num_components==1)?8:24) << 16; // Set bits per pel.
   header.compression = 0;
@@ -181,18 +830,59 @@ int bmp_out__open(bmp_out *state, const char *fname,
   header.xpels_per_metre = header.ypels_per_metre = 0;
   header.num_colours_used = header.num_colours_important = 0;
   to_little_endian((io_int32 *) &header,10);
-  if ((state->out = fopen(fname,"wb")) == NULL)
-    return(IO_ERR_NO_FILE);
-
-  fwrite(magic,1,14,state->out);
-  fwrite(&header,1,40,state->out);
+  memcpy(head+14,&header,40);
   if (num_components == 1)
     for (int n=0; n < 256; n++)
-      { fputc(n,state->out); fputc(n,state->out);
-        fputc(n,state->out); fputc(0,state->out); }
+      { io_byte *entry = head + 54 + 4*n;
+        entry[0] = entry[1] = entry[2] = (io_byte) n;  entry[3] = 0; }
+
+  state->stats = io_stats__create(fname,mapped != 0);
+  if (mapped)
+    {
+      if (io_mapping__open_write(&state->map,fname,(size_t) file_bytes) != 0)
+        { bmp_out__close(state); return(IO_ERR_NO_FILE); }
+      memcpy(state->map.base,head,(size_t) header_bytes);
+      state->first_line = state->map.base + header_bytes;
+      if (state->stats != NULL)
+        state->stats->bytes += (long long) file_bytes;
+      return 0;
+    }
+  if ((state->out = fopen(fname,"wb")) == NULL)
+    { bmp_out__close(state); return(IO_ERR_NO_FILE); }
+  counted_fwrite(head,(size_t) header_bytes,state->out,state->stats);
   return 0;
 }
 
+/*****************************************************************************/
+/*                               bmp_out__open                               */
+/*****************************************************************************/
+
+int bmp_out__open(bmp_out *state, const char *fname,
+                  int width, int height, int num_components)
+{
+  return open_out(state,fname,width,height,num_components,0,0);
+}
+
+/*****************************************************************************/
+/*                           bmp_out__open_top_down                          */
+/*****************************************************************************/
+
+int bmp_out__open_top_down(bmp_out *state, const char *fname,
+                           int width, int height, int num_components)
+{
+  return open_out(state,fname,width,height,num_components,1,0);
+}
+
+/*****************************************************************************/
+/*                           bmp_out__open_mapped                            */
+/*****************************************************************************/
+
+int bmp_out__open_mapped(bmp_out *state, const char *fname,
+                         int width, int height, int num_components)
+{
+  return open_out(state,fname,width,height,num_components,0,1);
+}
+
 /*****************************************************************************/
 /*                               bmp_out__close                              */
 /*****************************************************************************/
@@ -200,7 +890,14 @@ int bmp_out__open(bmp_out *state, const char *fname,
 void bmp_out__close(bmp_out *state)
 {
   if (state->out != NULL)
-    fclose(state->out);
+    { // Count the final flush of buffered lines as an I/O call
+      long long start = io_stats__start(state->stats);
+      fclose(state->out);
+      io_stats__add_io(state->stats,0,start);
+    }
+  io_mapping__close(&state->map);
+  free(state->scratch);
+  io_stats__close(state->stats,"write");
   memset(state,0,sizeof(bmp_out));
 }
 
@@ -210,16 +907,177 @@ void bmp_out__close(bmp_out *state)
 
 int bmp_out__put_line(bmp_out *state, io_byte *line)
 {
-  if ((state->out == NULL) || (state->num_unwritten_rows <= 0))
+  if (((state->out == NULL) && (state->first_line == NULL)) ||
+      (state->num_unwritten_rows <= 0))
     return(IO_ERR_FILE_NOT_OPEN);
+  if (state->first_line != NULL)
+    return bmp_out__put_lines(state,line,1);
   state->num_unwritten_rows--;
-  if (fwrite(line,1,(size_t) state->line_bytes,state->out) !=
+  io_stats__add_rows(state->stats,1);
+  if (counted_fwrite(line,(size_t) state->line_bytes,state->out,
+                     state->stats) !=
       (size_t) state->line_bytes)
     throw(IO_ERR_FILE_TRUNC);
   if (state->alignment_bytes > 0)
     {
       io_byte buf[3] = {0,0,0};
-        fwrite(buf,1,(size_t) state->alignment_bytes,state->out);
+        counted_fwrite(buf,(size_t) state->alignment_bytes,state->out,
+                       state->stats);
     }
   return 0;
 }
+
+/*****************************************************************************/
+/*                             bmp_out__put_lines                            */
+/*****************************************************************************/
+
+int bmp_out__put_lines(bmp_out *state, io_byte *buf, int num_lines)
+{
+  if (((state->out == NULL) && (state->first_line == NULL)) ||
+      (num_lines > state->num_unwritten_rows))
+    return(IO_ERR_FILE_NOT_OPEN);
+  size_t line_bytes = (size_t) state->line_bytes;
+  size_t padded_bytes = line_bytes + (size_t) state->alignment_bytes;
+  size_t total_bytes = padded_bytes * (size_t) num_lines;
+  io_stats__add_rows(state->stats,num_lines);
+  if (state->first_line != NULL)
+    { // Copy into the mapping, whose padding bytes are already zero
+      io_byte *dst = state->first_line + padded_bytes *
+        (size_t)(state->rows - state->num_unwritten_rows);
+      state->num_unwritten_rows -= num_lines;
+      for (; num_lines > 0; num_lines--, buf+=line_bytes, dst+=padded_bytes)
+        memcpy(dst,buf,line_bytes);
+      return 0;
+    }
+  io_byte *src = buf;
+  if (state->alignment_bytes != 0)
+    {
+      io_byte *dst =
+        get_scratch(&state->scratch,&state->scratch_bytes,total_bytes);
+      if (dst == NULL)
+        { // Fall back to writing one line at a time
+          for (; num_lines > 0; num_lines--, buf+=line_bytes)
+            {
+              state->num_unwritten_rows--;
+              if ((counted_fwrite(buf,line_bytes,state->out,
+                                  state->stats) != line_bytes) ||
+                  (counted_fwrite("\0\0\0",(size_t) state->alignment_bytes,
+                                  state->out,state->stats) !=
+                   (size_t) state->alignment_bytes))
+                return(IO_ERR_FILE_TRUNC);
+            }
+          return 0;
+        }
+      src = dst;
+      for (int n=num_lines; n > 0; n--, buf+=line_bytes, dst+=padded_bytes)
+        {
+          memcpy(dst,buf,line_bytes);
+          memset(dst+line_bytes,0,(size_t) state->alignment_bytes);
+        }
+    }
+  state->num_unwritten_rows -= num_lines;
+  if (counted_fwrite(src,total_bytes,state->out,state->stats) !=
+      total_bytes)
+    return(IO_ERR_FILE_TRUNC);
+  return 0;
+}
+
+/*****************************************************************************/
+/*                            bmp_out__preallocate                           */
+/*****************************************************************************/
+
+int bmp_out__preallocate(bmp_out *state)
+{
+  if (((state->out == NULL) && (state->first_line == NULL)) ||
+      state->preallocated || (state->num_unwritten_rows != state->rows))
+    return(IO_ERR_FILE_NOT_OPEN);
+  if (state->first_line != NULL)
+    { // Mapped files have their full length from the outset
+      state->preallocated = 1;
+      state->num_unwritten_rows = 0;
+      return 0;
+    }
+  long long file_bytes = state->data_offset + ((long long) state->rows) *
+    (long long)(state->line_bytes + state->alignment_bytes);
+  long long start = io_stats__start(state->stats);
+  if (io_file__set_size(state->out,file_bytes) != 0)
+    return(IO_ERR_FILE_TRUNC);
+  io_stats__add_io(state->stats,0,start);
+  state->preallocated = 1;
+  state->num_unwritten_rows = 0;
+  return 0;
+}
+
+/*****************************************************************************/
+/*                            bmp_out__write_rows                            */
+/*****************************************************************************/
+
+int bmp_out__write_rows(bmp_out *state, int first_row, int num_rows,
+                        const io_byte *buf)
+{
+  if (!state->preallocated)
+    return(IO_ERR_FILE_NOT_OPEN);
+  if ((first_row < 0) || (num_rows < 0) ||
+      (num_rows > (state->rows - first_row)))
+    return(IO_ERR_FILE_NOT_OPEN);
+  if (num_rows == 0)
+    return 0;
+  io_stats__add_rows(state->stats,num_rows);
+  if (state->first_line != NULL)
+    {
+      for (int r=first_row; num_rows > 0; num_rows--, r++,
+           buf+=state->line_bytes)
+        memcpy(bmp_out__row_ptr(state,r),buf,(size_t) state->line_bytes);
+      return 0;
+    }
+  size_t line_bytes = (size_t) state->line_bytes;
+  size_t padded_bytes = line_bytes + (size_t) state->alignment_bytes;
+
+  // As in `bmp_in__read_rows', the rows occupy one contiguous run of lines
+  // in the file, in reverse order if the file is bottom-up.
+  int first_idx = (state->top_down)?first_row:
+    (state->rows - first_row - num_rows);
+  long long offset = state->data_offset +
+    ((long long) first_idx) * (long long) padded_bytes;
+  size_t total_bytes = padded_bytes * (size_t) num_rows;
+  long long start = io_stats__start(state->stats);
+  if (state->top_down && (state->alignment_bytes == 0))
+    {
+      if (io_file__pwrite(state->out,buf,total_bytes,offset) != 0)
+        return(IO_ERR_FILE_TRUNC);
+      io_stats__add_io(state->stats,(long long) total_bytes,start);
+      return 0;
+    }
+  io_byte *dst = (io_byte *) malloc(total_bytes); // Private to this call
+  if (dst == NULL)
+    return(IO_ERR_FILE_TRUNC);
+  io_byte *dp = dst;
+  ptrdiff_t step = (ptrdiff_t) padded_bytes;
+  if (!state->top_down)
+    { dp += (num_rows-1)*padded_bytes;  step = -step; }
+  for (int n=num_rows; n > 0; n--, buf+=line_bytes, dp+=step)
+    {
+      memcpy(dp,buf,line_bytes);
+      memset(dp+line_bytes,0,(size_t) state->alignment_bytes);
+    }
+  int err_code = 0;
+  if (io_file__pwrite(state->out,dst,total_bytes,offset) != 0)
+    err_code = IO_ERR_FILE_TRUNC;
+  else
+    io_stats__add_io(state->stats,(long long) total_bytes,start);
+  free(dst);
+  return err_code;
+}
+
+/*****************************************************************************/
+/*                              bmp_out__row_ptr                             */
+/*****************************************************************************/
+
+io_byte *bmp_out__row_ptr(bmp_out *state, int r)
+{
+  if ((state->first_line == NULL) || (r < 0) || (r >= state->rows))
+    return NULL;
+  int idx = (state->top_down)?r:(state->rows-1-r);
+  return state->first_line +
+    ((size_t) idx) * (size_t)(state->line_bytes+state->alignment_bytes);
+}
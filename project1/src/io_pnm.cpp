@@ -0,0 +1,412 @@
+/*****************************************************************************/
+// File: io_pnm.cpp
+/*****************************************************************************/
+
+#include <string.h>
+#include "io_pnm.h"
+
+/* ========================================================================= */
+/*                             Internal Functions                            */
+/* ========================================================================= */
+
+/*****************************************************************************/
+/* STATIC                         read_token                                 */
+/*****************************************************************************/
+
+static int
+  read_token(const io_byte *buf, int len, int *pos)
+  /* Skips white space and comments from `*pos' onwards, then parses a
+     decimal number, leaving `*pos' just beyond its last digit.  Returns the
+     number, or -1 if there is none or it does not fit in an `int'. */
+{
+  int p = *pos;
+  while (p < len)
+    if (buf[p] == '#')
+      { // Comments run to the end of the line
+        while ((p < len) && (buf[p] != '\n') && (buf[p] != '\r'))
+          p++;
+      }
+    else if ((buf[p] == ' ') || (buf[p] == '\t') || (buf[p] == '\n') ||
+             (buf[p] == '\r') || (buf[p] == '\v') || (buf[p] == '\f'))
+      p++;
+    else
+      break;
+  if ((p >= len) || (buf[p] < '0') || (buf[p] > '9'))
+    return -1;
+  long long val = 0;
+  for (; (p < len) && (buf[p] >= '0') && (buf[p] <= '9'); p++)
+    if ((val = val*10 + (buf[p]-'0')) > 0x7FFFFFFF)
+      return -1;
+  *pos = p;
+  return (int) val;
+}
+
+/*****************************************************************************/
+/* STATIC                      parse_in_header                               */
+/*****************************************************************************/
+
+static int
+  parse_in_header(pnm_in *state, const io_byte *buf, int len)
+  /* Interprets the header at the start of `buf', which holds the first
+     `len' bytes of the file, filling in the dimensions of `state' and
+     `state->data_offset'.  Returns 0 or `IO_ERR_FILE_HEADER'. */
+{
+  if ((len < 2) || (buf[0] != 'P') || ((buf[1] != '5') && (buf[1] != '6')))
+    return(IO_ERR_FILE_HEADER);
+  int pos = 2;
+  int width = read_token(buf,len,&pos);
+  int height = read_token(buf,len,&pos);
+  int max_val = read_token(buf,len,&pos);
+  if ((width <= 0) || (height <= 0) || (max_val <= 0) || (max_val > 65535) ||
+      (pos >= len))
+    return(IO_ERR_FILE_HEADER);
+  pos++; // Exactly one white space character precedes the samples
+  state->num_components = (buf[1] == '5')?1:3;
+  state->rows = state->num_unread_rows = height;
+  state->cols = width;
+  state->max_val = max_val;
+  state->sample_bytes = (max_val > 255)?2:1;
+  long long line_bytes = ((long long) width) * state->num_components *
+    state->sample_bytes;
+  if (line_bytes > 0x7FFFFFFF)
+    return(IO_ERR_FILE_HEADER);
+  state->line_bytes = (int) line_bytes;
+  state->data_offset = pos;
+  return 0;
+}
+
+/*****************************************************************************/
+/* STATIC                         open_out                                   */
+/*****************************************************************************/
+
+static int
+  open_out(pnm_out *state, const char *fname, int width, int height,
+           int num_components, int max_val, int mapped)
+  /* Implements `pnm_out__open' and `pnm_out__open_mapped'. */
+{
+  memset(state,0,sizeof(pnm_out)); // Start by reseting everything
+  if ((width <= 0) || (height <= 0) || (max_val <= 0) || (max_val > 65535) ||
+      ((num_components != 1) && (num_components != 3)))
+    return(IO_ERR_UNSUPPORTED);
+  state->num_components = num_components;
+  state->rows = state->num_unwritten_rows = height;
+  state->cols = width;
+  state->max_val = max_val;
+  state->sample_bytes = (max_val > 255)?2:1;
+  state->line_bytes = width * num_components * state->sample_bytes;
+  char header[64];
+  state->data_offset =
+    sprintf(header,"P%c\n%d %d\n%d\n",(num_components==1)?'5':'6',
+            width,height,max_val);
+  if (mapped)
+    {
+      size_t file_bytes = ((size_t) state->data_offset) +
+        ((size_t) state->line_bytes) * (size_t) height;
+      if (io_mapping__open_write(&state->map,fname,file_bytes) != 0)
+        return(IO_ERR_NO_FILE);
+      memcpy(state->map.base,header,(size_t) state->data_offset);
+      state->first_line = state->map.base + state->data_offset;
+      return 0;
+    }
+  if ((state->out = fopen(fname,"wb")) == NULL)
+    return(IO_ERR_NO_FILE);
+  fwrite(header,1,(size_t) state->data_offset,state->out);
+  return 0;
+}
+
+/*****************************************************************************/
+/* STATIC                        check_dump_spec                             */
+/*****************************************************************************/
+
+static bool
+  check_dump_spec(const pnm_dump_spec *spec)
+  /* Returns true if `spec' describes a layout we can read, whose lines
+     also fit in the `int' used for `pnm_in::line_bytes'. */
+{
+  if ((spec->width <= 0) || (spec->height <= 0) ||
+      ((spec->num_components != 1) && (spec->num_components != 3)) ||
+      (spec->bit_depth < 1) || (spec->bit_depth > 16))
+    return false;
+  long long line_bytes = ((long long) spec->width) * spec->num_components *
+    ((spec->bit_depth > 8)?2:1);
+  return (line_bytes <= 0x7FFFFFFF);
+}
+
+/*****************************************************************************/
+/*                           pnm__file_name_matches                          */
+/*****************************************************************************/
+
+bool pnm__file_name_matches(const char *fname)
+{
+  size_t len = strlen(fname);
+  if (len < 4)
+    return false;
+  const char *suffix = fname + len - 4;
+  return (strcmp(suffix,".pgm") == 0) || (strcmp(suffix,".ppm") == 0) ||
+    (strcmp(suffix,".pnm") == 0);
+}
+
+
+/*****************************************************************************/
+/*                            pnm__parse_dump_name                           */
+/*****************************************************************************/
+
+int pnm__parse_dump_name(const char *fname, pnm_dump_spec *spec)
+{
+  memset(spec,0,sizeof(pnm_dump_spec));
+  const char *sep = strrchr(fname,PNM_DUMP_SEPARATOR);
+  if ((sep == NULL) || (sep == fname))
+    return -1;
+  const io_byte *buf = (const io_byte *)(sep+1);
+  int len = (int) strlen(sep+1), pos = 0, vals[4];
+  for (int n=0; n < 4; n++)
+    { // `read_token' stops at the 'x' which separates the fields
+      if ((n > 0) && ((pos >= len) || (buf[pos++] != 'x')))
+        return -1;
+      if ((pos >= len) || (buf[pos] < '0') || (buf[pos] > '9') ||
+          ((vals[n] = read_token(buf,len,&pos)) < 0))
+        return -1;
+    }
+  if ((pos+2 == len) && (buf[pos] == 'l') && (buf[pos+1] == 'e'))
+    { spec->little_endian = true;  pos += 2; }
+  if (pos != len)
+    return -1;
+  spec->width = vals[0];  spec->height = vals[1];
+  spec->num_components = vals[2];  spec->bit_depth = vals[3];
+  if (!check_dump_spec(spec))
+    return -1;
+  return (int)(sep - fname);
+}
+
+
+/* ========================================================================= */
+/*                                   pnm_in                                  */
+/* ========================================================================= */
+
+/*****************************************************************************/
+/*                                pnm_in__open                               */
+/*****************************************************************************/
+
+int pnm_in__open(pnm_in *state, const char *fname)
+{
+  memset(state,0,sizeof(pnm_in)); // Start by reseting everything
+  if ((state->in = fopen(fname,"rb")) == NULL)
+    return(IO_ERR_NO_FILE);
+  io_byte head[1024]; // Ample for any header without very long comments
+  int len = (int) fread(head,1,sizeof(head),state->in);
+  int err_code = parse_in_header(state,head,len);
+  if (err_code != 0)
+    { pnm_in__close(state); return err_code; }
+  fseek(state->in,state->data_offset,SEEK_SET);
+  return 0;
+}
+
+/*****************************************************************************/
+/*                            pnm_in__open_mapped                            */
+/*****************************************************************************/
+
+int pnm_in__open_mapped(pnm_in *state, const char *fname)
+{
+  memset(state,0,sizeof(pnm_in)); // Start by reseting everything
+  if (io_mapping__open_read(&state->map,fname) != 0)
+    return(IO_ERR_NO_FILE);
+  int len = (state->map.bytes > 1024)?1024:(int) state->map.bytes;
+  int err_code = parse_in_header(state,state->map.base,len);
+  if (err_code != 0)
+    { pnm_in__close(state); return err_code; }
+  size_t data_bytes = ((size_t) state->line_bytes) * (size_t) state->rows;
+  if ((state->map.bytes - (size_t) state->data_offset) < data_bytes)
+    { pnm_in__close(state); return(IO_ERR_FILE_TRUNC); }
+  state->first_line = state->map.base + state->data_offset;
+  return 0;
+}
+
+/*****************************************************************************/
+/*                          pnm_in__open_headerless                          */
+/*****************************************************************************/
+
+int pnm_in__open_headerless(pnm_in *state, const char *fname,
+                            const pnm_dump_spec *spec)
+{
+  memset(state,0,sizeof(pnm_in)); // Start by reseting everything
+  if (!check_dump_spec(spec))
+    return(IO_ERR_UNSUPPORTED);
+  if (io_mapping__open_read(&state->map,fname) != 0)
+    return(IO_ERR_NO_FILE);
+  state->num_components = spec->num_components;
+  state->rows = state->num_unread_rows = spec->height;
+  state->cols = spec->width;
+  state->max_val = (1 << spec->bit_depth) - 1;
+  state->sample_bytes = (spec->bit_depth > 8)?2:1;
+  state->little_endian = spec->little_endian && (state->sample_bytes == 2);
+  state->line_bytes =
+    spec->width * spec->num_components * state->sample_bytes;
+  size_t data_bytes = ((size_t) state->line_bytes) * (size_t) state->rows;
+  if (state->map.bytes < data_bytes)
+    { pnm_in__close(state); return(IO_ERR_FILE_TRUNC); }
+  state->first_line = state->map.base;
+  return 0;
+}
+
+/*****************************************************************************/
+/*                               pnm_in__close                               */
+/*****************************************************************************/
+
+void pnm_in__close(pnm_in *state)
+{
+  if (state->in != NULL)
+    fclose(state->in);
+  io_mapping__close(&state->map);
+  memset(state,0,sizeof(pnm_in));
+}
+
+/*****************************************************************************/
+/*                              pnm_in__get_line                             */
+/*****************************************************************************/
+
+int pnm_in__get_line(pnm_in *state, io_byte *line)
+{
+  return pnm_in__get_lines(state,line,1);
+}
+
+/*****************************************************************************/
+/*                              pnm_in__get_lines                            */
+/*****************************************************************************/
+
+int pnm_in__get_lines(pnm_in *state, io_byte *buf, int num_lines)
+{
+  if (((state->in == NULL) && (state->first_line == NULL)) ||
+      (num_lines < 0) || (num_lines > state->num_unread_rows))
+    return(IO_ERR_FILE_NOT_OPEN);
+  if (num_lines == 0)
+    return 0;
+  int first_row = state->rows - state->num_unread_rows;
+  state->num_unread_rows -= num_lines;
+  size_t total_bytes = ((size_t) state->line_bytes) * (size_t) num_lines;
+  if (state->first_line != NULL)
+    {
+      memcpy(buf,pnm_in__row_ptr(state,first_row),total_bytes);
+      return 0;
+    }
+  if (fread(buf,1,total_bytes,state->in) != total_bytes)
+    return(IO_ERR_FILE_TRUNC);
+  return 0;
+}
+
+/*****************************************************************************/
+/*                              pnm_in__read_rows                            */
+/*****************************************************************************/
+
+int pnm_in__read_rows(pnm_in *state, int first_row, int num_rows,
+                      io_byte *buf)
+{
+  if ((state->in == NULL) && (state->first_line == NULL))
+    return(IO_ERR_FILE_NOT_OPEN);
+  if ((first_row < 0) || (num_rows < 0) ||
+      (num_rows > (state->rows - first_row)))
+    return(IO_ERR_FILE_NOT_OPEN);
+  size_t total_bytes = ((size_t) state->line_bytes) * (size_t) num_rows;
+  if (total_bytes == 0)
+    return 0;
+  if (state->first_line != NULL)
+    {
+      memcpy(buf,pnm_in__row_ptr(state,first_row),total_bytes);
+      return 0;
+    }
+  long long offset = state->data_offset +
+    ((long long) first_row) * (long long) state->line_bytes;
+  return (io_file__pread(state->in,buf,total_bytes,offset) != 0)?
+    IO_ERR_FILE_TRUNC:0;
+}
+
+/*****************************************************************************/
+/*                              pnm_in__row_ptr                              */
+/*****************************************************************************/
+
+const io_byte *pnm_in__row_ptr(pnm_in *state, int r)
+{
+  if ((state->first_line == NULL) || (r < 0) || (r >= state->rows))
+    return NULL;
+  return state->first_line + ((size_t) r) * (size_t) state->line_bytes;
+}
+
+
+/* ========================================================================= */
+/*                                  pnm_out                                  */
+/* ========================================================================= */
+
+/*****************************************************************************/
+/*                               pnm_out__open                               */
+/*****************************************************************************/
+
+int pnm_out__open(pnm_out *state, const char *fname, int width, int height,
+                  int num_components, int max_val)
+{
+  return open_out(state,fname,width,height,num_components,max_val,0);
+}
+
+/*****************************************************************************/
+/*                            pnm_out__open_mapped                           */
+/*****************************************************************************/
+
+int pnm_out__open_mapped(pnm_out *state, const char *fname, int width,
+                         int height, int num_components, int max_val)
+{
+  return open_out(state,fname,width,height,num_components,max_val,1);
+}
+
+/*****************************************************************************/
+/*                               pnm_out__close                              */
+/*****************************************************************************/
+
+void pnm_out__close(pnm_out *state)
+{
+  if (state->out != NULL)
+    fclose(state->out);
+  io_mapping__close(&state->map);
+  memset(state,0,sizeof(pnm_out));
+}
+
+/*****************************************************************************/
+/*                              pnm_out__put_line                            */
+/*****************************************************************************/
+
+int pnm_out__put_line(pnm_out *state, const io_byte *line)
+{
+  return pnm_out__put_lines(state,line,1);
+}
+
+/*****************************************************************************/
+/*                             pnm_out__put_lines                            */
+/*****************************************************************************/
+
+int pnm_out__put_lines(pnm_out *state, const io_byte *buf, int num_lines)
+{
+  if (((state->out == NULL) && (state->first_line == NULL)) ||
+      (num_lines < 0) || (num_lines > state->num_unwritten_rows))
+    return(IO_ERR_FILE_NOT_OPEN);
+  if (num_lines == 0)
+    return 0;
+  int first_row = state->rows - state->num_unwritten_rows;
+  state->num_unwritten_rows -= num_lines;
+  size_t total_bytes = ((size_t) state->line_bytes) * (size_t) num_lines;
+  if (state->first_line != NULL)
+    {
+      memcpy(pnm_out__row_ptr(state,first_row),buf,total_bytes);
+      return 0;
+    }
+  if (fwrite(buf,1,total_bytes,state->out) != total_bytes)
+    return(IO_ERR_FILE_TRUNC);
+  return 0;
+}
+
+/*****************************************************************************/
+/*                              pnm_out__row_ptr                             */
+/*****************************************************************************/
+
+io_byte *pnm_out__row_ptr(pnm_out *state, int r)
+{
+  if ((state->first_line == NULL) || (r < 0) || (r >= state->rows))
+    return NULL;
+  return state->first_line + ((size_t) r) * (size_t) state->line_bytes;
+}
@@ -0,0 +1,120 @@
+/*****************************************************************************/
+// File: io_raw.cpp
+/*****************************************************************************/
+
+#include "io_raw.h"
+
+/* ========================================================================= */
+/*                                  raw_in                                   */
+/* ========================================================================= */
+
+/*****************************************************************************/
+/*                                raw_in__open                               */
+/*****************************************************************************/
+
+int raw_in__open(raw_in *state, const char *fname)
+{
+  memset(state,0,sizeof(raw_in)); // Start by reseting everything
+  if (io_mapping__open_read(&state->map,fname) != 0)
+    return(IO_ERR_NO_FILE);
+  raw_header header;
+  if (state->map.bytes < sizeof(header))
+    return(IO_ERR_FILE_TRUNC);
+  memcpy(&header,state->map.base,sizeof(header));
+  if ((memcmp(header.magic,RAW_MAGIC,4) != 0) ||
+      (header.header_bytes < (io_int32) sizeof(header)) ||
+      ((header.header_bytes & 3) != 0) || (header.width <= 0) ||
+      (header.height <= 0) || (header.num_planes <= 0))
+    return(IO_ERR_FILE_HEADER);
+  state->num_components = header.num_planes;
+  state->rows = header.height;
+  state->cols = header.width;
+  size_t data_bytes = sizeof(float) * ((size_t) header.width) *
+    ((size_t) header.height) * ((size_t) header.num_planes);
+  if ((state->map.bytes < (size_t) header.header_bytes) ||
+      ((state->map.bytes - (size_t) header.header_bytes) < data_bytes))
+    return(IO_ERR_FILE_TRUNC);
+  state->first_sample =
+    (const float *)(state->map.base + header.header_bytes);
+  return 0;
+}
+
+/*****************************************************************************/
+/*                                raw_in__close                              */
+/*****************************************************************************/
+
+void raw_in__close(raw_in *state)
+{
+  io_mapping__close(&state->map);
+  memset(state,0,sizeof(raw_in));
+}
+
+/*****************************************************************************/
+/*                               raw_in__row_ptr                             */
+/*****************************************************************************/
+
+const float *raw_in__row_ptr(raw_in *state, int comp_idx, int r)
+{
+  if ((state->first_sample == NULL) || (r < 0) || (r >= state->rows) ||
+      (comp_idx < 0) || (comp_idx >= state->num_components))
+    return NULL;
+  return state->first_sample +
+    (((size_t) comp_idx)*state->rows + (size_t) r) * (size_t) state->cols;
+}
+
+
+/* ========================================================================= */
+/*                                 raw_out                                   */
+/* ========================================================================= */
+
+/*****************************************************************************/
+/*                               raw_out__open                               */
+/*****************************************************************************/
+
+int raw_out__open(raw_out *state, const char *fname,
+                  int width, int height, int num_components)
+{
+  memset(state,0,sizeof(raw_out)); // Start by reseting everything
+  if ((width <= 0) || (height <= 0) || (num_components <= 0))
+    return(IO_ERR_UNSUPPORTED);
+  state->num_components = num_components;
+  state->rows = height;
+  state->cols = width;
+  raw_header header;
+  memset(&header,0,sizeof(header));
+  memcpy(header.magic,RAW_MAGIC,4);
+  header.header_bytes = (io_int32) sizeof(header);
+  header.width = width;
+  header.height = height;
+  header.num_planes = num_components;
+  size_t file_bytes = sizeof(header) + sizeof(float) * ((size_t) width) *
+    ((size_t) height) * ((size_t) num_components);
+  if (io_mapping__open_write(&state->map,fname,file_bytes) != 0)
+    return(IO_ERR_NO_FILE);
+  memcpy(state->map.base,&header,sizeof(header));
+  state->first_sample = (float *)(state->map.base + sizeof(header));
+  return 0;
+}
+
+/*****************************************************************************/
+/*                               raw_out__close                              */
+/*****************************************************************************/
+
+void raw_out__close(raw_out *state)
+{
+  io_mapping__close(&state->map);
+  memset(state,0,sizeof(raw_out));
+}
+
+/*****************************************************************************/
+/*                              raw_out__row_ptr                             */
+/*****************************************************************************/
+
+float *raw_out__row_ptr(raw_out *state, int comp_idx, int r)
+{
+  if ((state->first_sample == NULL) || (r < 0) || (r >= state->rows) ||
+      (comp_idx < 0) || (comp_idx >= state->num_components))
+    return NULL;
+  return state->first_sample +
+    (((size_t) comp_idx)*state->rows + (size_t) r) * (size_t) state->cols;
+}
@@ -0,0 +1,93 @@
+/*****************************************************************************/
+// File: io_stats.cpp
+/*****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include "io_stats.h"
+
+static int stats_override = -1; // -1 means follow the environment
+
+/*****************************************************************************/
+/* STATIC                        env_enabled                                 */
+/*****************************************************************************/
+
+static bool
+  env_enabled()
+  /* Returns true if the `IO_STATS' environment variable asks for
+     statistics.  The environment is examined only on the first call. */
+{
+  static const bool enabled = []{
+      const char *val = getenv("IO_STATS");
+      return (val != NULL) && (*val != '\0') && (strcmp(val,"0") != 0);
+    }();
+  return enabled;
+}
+
+/*****************************************************************************/
+/*                              io_clock__ticks                              */
+/*****************************************************************************/
+
+long long io_clock__ticks()
+{
+  return (long long) std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/*****************************************************************************/
+/*                           io_stats__set_enabled                           */
+/*****************************************************************************/
+
+void io_stats__set_enabled(bool enable)
+{
+  stats_override = (enable)?1:0;
+}
+
+/*****************************************************************************/
+/*                              io_stats__create                             */
+/*****************************************************************************/
+
+io_stats *io_stats__create(const char *fname, bool mapped)
+{
+  if ((stats_override == 0) || ((stats_override < 0) && !env_enabled()))
+    return NULL;
+  io_stats *stats = new io_stats;
+  stats->bytes = stats->calls = 0;
+  stats->io_ticks = stats->wait_ticks = stats->convert_ticks = 0;
+  stats->rows = 0;
+  stats->open_ticks = io_clock__ticks();
+  stats->mapped = mapped;
+  size_t len = strlen(fname);
+  if (len >= sizeof(stats->name))
+    fname += len - (sizeof(stats->name)-1); // Keep the end of long names
+  strcpy(stats->name,fname);
+  return stats;
+}
+
+/*****************************************************************************/
+/*                              io_stats__close                              */
+/*****************************************************************************/
+
+void io_stats__close(io_stats *stats, const char *direction)
+{
+  if (stats == NULL)
+    return;
+  if (env_enabled())
+    {
+      double open_ms = 1.0E-6 * (double)(io_clock__ticks()-stats->open_ticks);
+      double rows_per_sec =
+        (open_ms > 0.0)?(1000.0 * (double) stats->rows / open_ms):0.0;
+      fprintf(stderr,"io_stats: %s (%s%s): %lld bytes in %lld calls; "
+              "%.3f ms in I/O, %.3f ms waiting, %.3f ms converting; "
+              "%lld rows in %.3f ms open (%.0f rows/s)\n",
+              stats->name,direction,(stats->mapped)?", mapped":"",
+              (long long) stats->bytes,(long long) stats->calls,
+              1.0E-6 * (double) stats->io_ticks,
+              1.0E-6 * (double) stats->wait_ticks,
+              1.0E-6 * (double) stats->convert_ticks,
+              (long long) stats->rows,open_ms,rows_per_sec);
+    }
+  delete stats;
+}
@@ -0,0 +1,243 @@
+/*****************************************************************************/
+// File: io_sys.cpp
+/*****************************************************************************/
+
+#include <string.h>
+#include "io_sys.h"
+#ifdef _WIN32
+#  define WIN32_LEAN_AND_MEAN
+#  include <windows.h>
+#  include <io.h>
+#else
+#  include <errno.h>
+#  include <fcntl.h>
+#  include <unistd.h>
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#endif
+
+/* ========================================================================= */
+/*                                io_mapping                                 */
+/* ========================================================================= */
+
+/*****************************************************************************/
+/*                           io_mapping__open_read                           */
+/*****************************************************************************/
+
+int io_mapping__open_read(io_mapping *map, const char *fname)
+{
+  memset(map,0,sizeof(io_mapping));
+#ifdef _WIN32
+  HANDLE file = CreateFileA(fname,GENERIC_READ,FILE_SHARE_READ,NULL,
+                            OPEN_EXISTING,FILE_ATTRIBUTE_NORMAL,NULL);
+  if (file == INVALID_HANDLE_VALUE)
+    return -1;
+  map->file_handle = file;
+  LARGE_INTEGER size;
+  if (!GetFileSizeEx(file,&size) || (size.QuadPart <= 0) ||
+      ((unsigned long long) size.QuadPart > (size_t) -1))
+    { io_mapping__close(map); return -1; }
+  map->bytes = (size_t) size.QuadPart;
+  HANDLE mapping = CreateFileMappingA(file,NULL,PAGE_READONLY,0,0,NULL);
+  if (mapping == NULL)
+    { io_mapping__close(map); return -1; }
+  map->map_handle = mapping;
+  map->base = (unsigned char *) MapViewOfFile(mapping,FILE_MAP_READ,0,0,0);
+  if (map->base == NULL)
+    { io_mapping__close(map); return -1; }
+#else
+  map->fd = open(fname,O_RDONLY);
+  if (map->fd < 0)
+    { map->fd = 0; return -1; }
+  struct stat st;
+  if ((fstat(map->fd,&st) != 0) || (st.st_size <= 0))
+    { io_mapping__close(map); return -1; }
+  map->bytes = (size_t) st.st_size;
+  void *addr = mmap(NULL,map->bytes,PROT_READ,MAP_SHARED,map->fd,0);
+  if (addr == MAP_FAILED)
+    { io_mapping__close(map); return -1; }
+  map->base = (unsigned char *) addr;
+  madvise(addr,map->bytes,MADV_WILLNEED); // Rows may be visited in any order
+#endif
+  return 0;
+}
+
+/*****************************************************************************/
+/*                          io_mapping__open_write                           */
+/*****************************************************************************/
+
+int io_mapping__open_write(io_mapping *map, const char *fname,
+                           size_t num_bytes)
+{
+  memset(map,0,sizeof(io_mapping));
+  if (num_bytes == 0)
+    return -1;
+#ifdef _WIN32
+  HANDLE file = CreateFileA(fname,GENERIC_READ|GENERIC_WRITE,0,NULL,
+                            CREATE_ALWAYS,FILE_ATTRIBUTE_NORMAL,NULL);
+  if (file == INVALID_HANDLE_VALUE)
+    return -1;
+  map->file_handle = file;
+  map->bytes = num_bytes;
+  unsigned long long size = (unsigned long long) num_bytes;
+  HANDLE mapping = // Also extends the file to `num_bytes'
+    CreateFileMappingA(file,NULL,PAGE_READWRITE,(DWORD)(size>>32),
+                       (DWORD) size,NULL);
+  if (mapping == NULL)
+    { io_mapping__close(map); return -1; }
+  map->map_handle = mapping;
+  map->base = (unsigned char *) MapViewOfFile(mapping,FILE_MAP_WRITE,0,0,0);
+  if (map->base == NULL)
+    { io_mapping__close(map); return -1; }
+#else
+  map->fd = open(fname,O_RDWR|O_CREAT|O_TRUNC,0644);
+  if (map->fd < 0)
+    { map->fd = 0; return -1; }
+  map->bytes = num_bytes;
+  if (ftruncate(map->fd,(off_t) num_bytes) != 0)
+    { io_mapping__close(map); return -1; }
+  int err = posix_fallocate(map->fd,0,(off_t) num_bytes);
+  if ((err != 0) && (err != EINVAL) && (err != EOPNOTSUPP))
+    { io_mapping__close(map); return -1; } // Disk full
+  void *addr = mmap(NULL,num_bytes,PROT_READ|PROT_WRITE,MAP_SHARED,
+                    map->fd,0);
+  if (addr == MAP_FAILED)
+    { io_mapping__close(map); return -1; }
+  map->base = (unsigned char *) addr;
+#endif
+  return 0;
+}
+
+/*****************************************************************************/
+/*                             io_mapping__close                             */
+/*****************************************************************************/
+
+void io_mapping__close(io_mapping *map)
+{
+#ifdef _WIN32
+  if (map->base != NULL)
+    UnmapViewOfFile(map->base);
+  if (map->map_handle != NULL)
+    CloseHandle((HANDLE) map->map_handle);
+  if (map->file_handle != NULL)
+    CloseHandle((HANDLE) map->file_handle);
+#else
+  if (map->base != NULL)
+    munmap(map->base,map->bytes);
+  if (map->fd > 0)
+    close(map->fd);
+#endif
+  memset(map,0,sizeof(io_mapping));
+}
+
+
+/* ========================================================================= */
+/*                          Positional file access                           */
+/* ========================================================================= */
+
+/*****************************************************************************/
+/*                               io_file__pread                              */
+/*****************************************************************************/
+
+int io_file__pread(FILE *fp, void *buf, size_t num_bytes, long long offset)
+{
+  unsigned char *dst = (unsigned char *) buf;
+#ifdef _WIN32
+  HANDLE file = (HANDLE) _get_osfhandle(_fileno(fp));
+  if (file == INVALID_HANDLE_VALUE)
+    return -1;
+  while (num_bytes > 0)
+    {
+      DWORD chunk = (num_bytes > 0x40000000)?0x40000000:(DWORD) num_bytes;
+      OVERLAPPED ov;
+      memset(&ov,0,sizeof(ov));
+      ov.Offset = (DWORD) offset;
+      ov.OffsetHigh = (DWORD)(offset >> 32);
+      DWORD got = 0;
+      if (!ReadFile(file,dst,chunk,&got,&ov) || (got == 0))
+        return -1;
+      dst += got;  num_bytes -= got;  offset += got;
+    }
+#else
+  int fd = fileno(fp);
+  while (num_bytes > 0)
+    {
+      ssize_t got = pread(fd,dst,num_bytes,(off_t) offset);
+      if ((got < 0) && (errno == EINTR))
+        continue; // Interrupted by a signal before reading anything
+      if (got <= 0)
+        return -1; // Read error, or end of file if `got' is 0
+      dst += got;  num_bytes -= (size_t) got;  offset += got;
+    }
+#endif
+  return 0;
+}
+
+/*****************************************************************************/
+/*                              io_file__pwrite                              */
+/*****************************************************************************/
+
+int io_file__pwrite(FILE *fp, const void *buf, size_t num_bytes,
+                    long long offset)
+{
+  const unsigned char *src = (const unsigned char *) buf;
+#ifdef _WIN32
+  HANDLE file = (HANDLE) _get_osfhandle(_fileno(fp));
+  if (file == INVALID_HANDLE_VALUE)
+    return -1;
+  while (num_bytes > 0)
+    {
+      DWORD chunk = (num_bytes > 0x40000000)?0x40000000:(DWORD) num_bytes;
+      OVERLAPPED ov;
+      memset(&ov,0,sizeof(ov));
+      ov.Offset = (DWORD) offset;
+      ov.OffsetHigh = (DWORD)(offset >> 32);
+      DWORD put = 0;
+      if (!WriteFile(file,src,chunk,&put,&ov) || (put == 0))
+        return -1;
+      src += put;  num_bytes -= put;  offset += put;
+    }
+#else
+  int fd = fileno(fp);
+  while (num_bytes > 0)
+    {
+      ssize_t put = pwrite(fd,src,num_bytes,(off_t) offset);
+      if ((put < 0) && (errno == EINTR))
+        continue; // Interrupted by a signal before writing anything
+      if (put <= 0)
+        return -1;
+      src += put;  num_bytes -= (size_t) put;  offset += put;
+    }
+#endif
+  return 0;
+}
+
+/*****************************************************************************/
+/*                             io_file__set_size                             */
+/*****************************************************************************/
+
+int io_file__set_size(FILE *fp, long long num_bytes)
+{
+  if (fflush(fp) != 0)
+    return -1;
+#ifdef _WIN32
+  HANDLE file = (HANDLE) _get_osfhandle(_fileno(fp));
+  if (file == INVALID_HANDLE_VALUE)
+    return -1;
+  LARGE_INTEGER pos, end;
+  pos.QuadPart = 0;
+  end.QuadPart = num_bytes;
+  if (!SetFilePointerEx(file,pos,&pos,FILE_CURRENT) ||
+      !SetFilePointerEx(file,end,NULL,FILE_BEGIN) || !SetEndOfFile(file) ||
+      !SetFilePointerEx(file,pos,NULL,FILE_BEGIN))
+    return -1;
+#else
+  int fd = fileno(fp);
+  if (ftruncate(fd,(off_t) num_bytes) != 0)
+    return -1;
+  int err = posix_fallocate(fd,0,(off_t) num_bytes);
+  if ((err != 0) && (err != EINVAL) && (err != EOPNOTSUPP))
+    return -1; // Out of space; other errors just mean no reservation
+#endif
+  return 0;
+}
@@ -0,0 +1,75 @@
+/*****************************************************************************/
+// File: multi_image_comps.cpp
+/*****************************************************************************/
+
+#include <string.h>
+#include "multi_image_comps.h"
+#include "thread_stripes.h"
+
+/*****************************************************************************/
+/*                         my_multi_image::first_touch                       */
+/*****************************************************************************/
+
+void my_multi_image::first_touch(int num_threads)
+{
+  size_t row_bytes = sizeof(float) * (size_t) stride;
+  run_stripes(height,num_threads,[&](int first_row, int lim_row, int /*s*/)
+    {
+      if (first_row == 0)
+        first_row = -border; // First stripe takes the top border rows
+      if (lim_row == height)
+        lim_row = height + border; // Last stripe takes the bottom ones
+      size_t num_rows = (size_t)(lim_row - first_row);
+      if (layout == MY_LAYOUT_ROW_INTERLEAVED)
+        memset(row(0,first_row)-border,0,row_bytes*num_rows*num_comps);
+      else
+        for (int n=0; n < num_comps; n++)
+          memset(row(n,first_row)-border,0,row_bytes*num_rows);
+    });
+}
+
+/*****************************************************************************/
+/*                  my_multi_image::perform_boundary_extension               */
+/*****************************************************************************/
+
+void my_multi_image::perform_boundary_extension(BoundaryExtensionType type,
+                                                int num_threads)
+{
+  if (border <= 0)
+    return;
+
+  // Extend each row to the left and right, for all channels at once
+  run_stripes(height,num_threads,[&](int first_row, int lim_row, int /*s*/)
+    {
+      for (const my_multi_row &row : rows(first_row,lim_row))
+        for (int n=0; n < num_comps; n++)
+          comp(n).extend_row_edges(type,row.r);
+    });
+
+  // Then fill the border rows above and below, again channel by channel
+  // within each row
+  run_stripes(2*border,num_threads,[&](int first, int lim, int /*s*/)
+    {
+      for (int k=first; k < lim; k++)
+        for (int n=0; n < num_comps; n++)
+          comp(n).fill_border_row(type,k);
+    });
+}
+
+/*****************************************************************************/
+/*                        my_multi_image::vector_filter                      */
+/*****************************************************************************/
+
+void my_multi_image::vector_filter(const my_multi_image &in, int num_threads)
+{
+  assert(in.num_comps == num_comps);
+  run_stripes(height,num_threads,[&](int first_row, int lim_row, int /*s*/)
+    {
+      for (const my_multi_row &row : rows(first_row,lim_row))
+        for (int n=0; n < num_comps; n++)
+          { // One-row views of the output and input components
+            my_image_view out_row = comp(n).crop(row.r,0,1,width);
+            out_row.vector_filter(in.comp(n).crop(row.r,0,1,width));
+          }
+    });
+}
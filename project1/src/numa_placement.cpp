@@ -0,0 +1,189 @@
+/*****************************************************************************/
+// File: numa_placement.cpp
+/*****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <mutex>
+#include "numa_placement.h"
+#ifdef _WIN32
+#  include <windows.h>
+#else
+#  ifndef _GNU_SOURCE
+#    define _GNU_SOURCE
+#  endif
+#  include <sched.h>
+#endif
+
+#define MAX_NODES 256
+
+static std::once_flag init_once;
+static int num_nodes = 1;
+static int node_ids[MAX_NODES] = {0}; // System numbers of the nodes we use
+static std::atomic<bool> binding(false);
+
+/* ========================================================================= */
+/*                             Internal Functions                            */
+/* ========================================================================= */
+
+#ifndef _WIN32
+/*****************************************************************************/
+/* STATIC                        read_id_list                                */
+/*****************************************************************************/
+
+static int
+  read_id_list(const char *path, cpu_set_t *ids)
+  /* Fills `ids' from a sysfs file such as
+     /sys/devices/system/node/node<n>/cpulist, which holds ranges such as
+     "0-15,32-47", and returns the number of ids read, which is 0 if there
+     is no such file.  Node numbers are read into a `cpu_set_t' as well,
+     since Linux numbers nodes below 1024, which is `CPU_SETSIZE'. */
+{
+  char list[1024];
+  FILE *fp = fopen(path,"r");
+  CPU_ZERO(ids);
+  if (fp == NULL)
+    return 0;
+  bool ok = (fgets(list,sizeof(list),fp) != NULL);
+  fclose(fp);
+  if (!ok)
+    return 0;
+  int count = 0;
+  for (char *cp=list; (*cp >= '0') && (*cp <= '9'); )
+    {
+      int first = (int) strtol(cp,&cp,10), last = first;
+      if (*cp == '-')
+        last = (int) strtol(cp+1,&cp,10);
+      for (int c=first; (c <= last) && (c < CPU_SETSIZE); c++, count++)
+        CPU_SET(c,ids);
+      if (*cp == ',')
+        cp++;
+    }
+  return count;
+}
+
+/*****************************************************************************/
+/* STATIC                       read_node_cpus                               */
+/*****************************************************************************/
+
+static bool
+  read_node_cpus(int node, cpu_set_t *cpus)
+  /* Fills `cpus' with the processors of system node number `node'.
+     Returns false if there is no such node or it has no processors, as
+     with memory-only (HBM or CXL) nodes. */
+{
+  char path[64];
+  snprintf(path,sizeof(path),"/sys/devices/system/node/node%d/cpulist",node);
+  return (read_id_list(path,cpus) > 0);
+}
+#endif // !_WIN32
+
+/*****************************************************************************/
+/* STATIC                          init_numa                                 */
+/*****************************************************************************/
+
+static void
+  init_numa()
+{
+#ifdef _WIN32
+  ULONG highest = 0;
+  if (GetNumaHighestNodeNumber(&highest))
+    num_nodes = ((int) highest < MAX_NODES)?((int) highest + 1):MAX_NODES;
+  for (int n=0; n < num_nodes; n++)
+    node_ids[n] = n;
+#else
+  cpu_set_t online, cpus;
+  int n = 0;
+  if (read_id_list("/sys/devices/system/node/online",&online) > 0)
+    for (int node=0; (node < CPU_SETSIZE) && (n < MAX_NODES); node++)
+      if (CPU_ISSET(node,&online) && read_node_cpus(node,&cpus))
+        node_ids[n++] = node; // Numbering may have gaps; skip CPU-less nodes
+  if (n > 1)
+    num_nodes = n;
+#endif
+  const char *val = getenv("MY_NUMA_BIND");
+  if ((val != NULL) && ((strcmp(val,"1") == 0) || (strcmp(val,"on") == 0)))
+    binding = true;
+}
+
+/* ========================================================================= */
+/*                             External Functions                            */
+/* ========================================================================= */
+
+/*****************************************************************************/
+/*                              numa__num_nodes                              */
+/*****************************************************************************/
+
+int numa__num_nodes()
+{
+  std::call_once(init_once,init_numa);
+  return num_nodes;
+}
+
+/*****************************************************************************/
+/*                             numa__set_binding                             */
+/*****************************************************************************/
+
+void numa__set_binding(bool enable)
+{
+  std::call_once(init_once,init_numa);
+  binding = enable;
+}
+
+/*****************************************************************************/
+/*                           numa__binding_enabled                           */
+/*****************************************************************************/
+
+bool numa__binding_enabled()
+{
+  std::call_once(init_once,init_numa);
+  return binding && (num_nodes > 1);
+}
+
+/*****************************************************************************/
+/*                  numa_stripe_binding::numa_stripe_binding                 */
+/*****************************************************************************/
+
+numa_stripe_binding::numa_stripe_binding(int s, int num_stripes)
+{
+  bound = false;
+  if (!numa__binding_enabled())
+    return;
+  int node = node_ids[numa__stripe_node(s,num_stripes)];
+#ifdef _WIN32
+  static_assert(sizeof(GROUP_AFFINITY) <= sizeof(saved),"`saved' too small");
+  GROUP_AFFINITY affinity, previous;
+  memset(&affinity,0,sizeof(affinity));
+  if (GetNumaNodeProcessorMaskEx((USHORT) node,&affinity) &&
+      SetThreadGroupAffinity(GetCurrentThread(),&affinity,&previous))
+    { memcpy(saved,&previous,sizeof(previous));  bound = true; }
+#else
+  static_assert(sizeof(cpu_set_t) <= sizeof(saved),"`saved' too small");
+  cpu_set_t cpus, previous;
+  if (read_node_cpus(node,&cpus) &&
+      (sched_getaffinity(0,sizeof(previous),&previous) == 0) &&
+      (sched_setaffinity(0,sizeof(cpus),&cpus) == 0))
+    { memcpy(saved,&previous,sizeof(previous));  bound = true; }
+#endif
+}
+
+/*****************************************************************************/
+/*                 numa_stripe_binding::~numa_stripe_binding                 */
+/*****************************************************************************/
+
+numa_stripe_binding::~numa_stripe_binding()
+{
+  if (!bound)
+    return;
+#ifdef _WIN32
+  GROUP_AFFINITY previous;
+  memcpy(&previous,saved,sizeof(previous));
+  SetThreadGroupAffinity(GetCurrentThread(),&previous,NULL);
+#else
+  cpu_set_t previous;
+  memcpy(&previous,saved,sizeof(previous));
+  sched_setaffinity(0,sizeof(previous),&previous);
+#endif
+}
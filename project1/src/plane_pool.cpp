@@ -0,0 +1,480 @@
+/*****************************************************************************/
+// File: plane_pool.cpp
+/*****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include "plane_pool.h"
+#include "aligned_image_comps.h" // For `my_aligned_alloc' and the alignment
+#ifdef _WIN32
+#  include <windows.h>
+#else
+#  include <sys/mman.h>
+#endif
+
+#define POOL_ALIGNMENT    MY_COMP_ALIGNMENT // All pooled blocks have this
+#define POOL_MIN_SHIFT    6 // Requests up to 64 bytes share the first classes
+#define POOL_NUM_CLASSES  (4*(64-POOL_MIN_SHIFT))
+#define POOL_CACHE_BLOCKS 2 // Blocks of each class kept by each thread
+#define POOL_HUGE_PAGE    (((size_t) 1) << 21) // 2 MB on X86
+#define POOL_HUGE_DEFAULT (((size_t) 32) << 20) // Default threshold
+
+/*****************************************************************************/
+/* STRUCT                       pool_block_info                              */
+/*****************************************************************************/
+
+struct pool_block_info {
+    size_t map_bytes; // Length of a huge page mapping; 0 for other blocks
+    int size_class; // -1 if the block is not to be pooled
+    int header_bytes; // Distance from the allocated address to the block
+    int huge_granted; // See below
+  };
+  /* Notes:
+        Every block is preceded by a header, `header_bytes' long, which keeps
+     the block itself aligned; this structure occupies the last bytes of the
+     header, immediately below the block.
+        Blocks whose size reaches the huge page threshold are mapped directly
+     from the operating system, starting on a 2 MB boundary, rather than
+     coming from `my_aligned_alloc'; `map_bytes' is then non-zero.
+     `huge_granted' is 1 if the system accepted the request for huge pages
+     (Windows large pages, or Linux `madvise(MADV_HUGEPAGE)'), else 0. */
+
+// Header length for a block aligned to `alignment' bytes: the smallest
+// multiple of `alignment' which holds a `pool_block_info'
+#define POOL_HEADER_BYTES(alignment) \
+  ((int)((sizeof(pool_block_info) + (alignment)-1) & ~((size_t)(alignment)-1)))
+static_assert((POOL_HEADER_BYTES(POOL_ALIGNMENT) % POOL_ALIGNMENT == 0) &&
+              (POOL_HEADER_BYTES(POOL_ALIGNMENT) >=
+               (int) sizeof(pool_block_info)),
+              "pool block header must hold `pool_block_info' and keep the "
+              "block `POOL_ALIGNMENT'-aligned");
+
+/*****************************************************************************/
+/* STRUCT                          pool_cache                                */
+/*****************************************************************************/
+
+struct pool_cache {
+    std::vector<float *> lists[POOL_NUM_CLASSES];
+    ~pool_cache();
+  };
+  /* Notes:
+        Each thread's private store of idle blocks.  The destructor, run
+     when the thread exits, moves whatever is left into the shared pool. */
+
+/*****************************************************************************/
+/* STRUCT                         pool_shared                                */
+/*****************************************************************************/
+
+struct pool_shared {
+    std::mutex mutex;
+    std::vector<float *> lists[POOL_NUM_CLASSES];
+    ~pool_shared();
+  };
+  /* Notes:
+        Idle blocks which any thread may take.  The destructor frees them all
+     when the program exits, after every thread's cache has been emptied
+     into it. */
+
+static pool_shared shared;
+static std::atomic<size_t> idle_bytes(0);
+static std::atomic<size_t> idle_limit(((size_t) 1) << 30);
+static thread_local pool_cache cache;
+static std::atomic<size_t> huge_threshold(POOL_HUGE_DEFAULT);
+static std::once_flag huge_env_once;
+
+/* ========================================================================= */
+/*                             Internal Functions                            */
+/* ========================================================================= */
+
+/*****************************************************************************/
+/* STATIC                         find_class                                 */
+/*****************************************************************************/
+
+static int
+  find_class(size_t num_bytes)
+  /* Returns the smallest size class whose blocks hold `num_bytes'.  Each
+     power of 2 is split into 4 classes, so that no more than a quarter of a
+     block is ever wasted. */
+{
+  int k = POOL_MIN_SHIFT;
+  while ((((size_t) 1) << k) < num_bytes)
+    k++; // Now 2^(k-1) < `num_bytes' <= 2^k (or k = `POOL_MIN_SHIFT')
+  size_t step = ((size_t) 1) << (k-3);
+  size_t base = ((size_t) 1) << (k-1);
+  int sub = (num_bytes <= base)?0:(int)((num_bytes - base - 1) / step);
+  return 4*(k-POOL_MIN_SHIFT) + sub;
+}
+
+/*****************************************************************************/
+/* STATIC                         class_bytes                                */
+/*****************************************************************************/
+
+static size_t
+  class_bytes(int size_class)
+{
+  int k = (size_class >> 2) + POOL_MIN_SHIFT;
+  return (((size_t) 1) << (k-1)) + ((size_t)((size_class & 3)+1) << (k-3));
+}
+
+/*****************************************************************************/
+/* INLINE                          block_info                                */
+/*****************************************************************************/
+
+static inline pool_block_info *
+  block_info(float *block)
+{
+  return ((pool_block_info *) block) - 1;
+}
+
+/*****************************************************************************/
+/* STATIC                        parse_bytes                                 */
+/*****************************************************************************/
+
+static bool
+  parse_bytes(const char *string, size_t *num_bytes)
+  /* Parses a decimal number of bytes, optionally followed by K, M or G, and
+     returns false if `string' is anything else. */
+{
+  char *end = NULL;
+  unsigned long long val = strtoull(string,&end,10);
+  if (end == string)
+    return false;
+  if ((*end == 'K') || (*end == 'k'))
+    { val <<= 10;  end++; }
+  else if ((*end == 'M') || (*end == 'm'))
+    { val <<= 20;  end++; }
+  else if ((*end == 'G') || (*end == 'g'))
+    { val <<= 30;  end++; }
+  if (*end != '\0')
+    return false;
+  *num_bytes = (size_t) val;
+  return true;
+}
+
+/*****************************************************************************/
+/* STATIC                     read_huge_page_env                             */
+/*****************************************************************************/
+
+static void
+  read_huge_page_env()
+  /* Applies the `PLANE_POOL_HUGE_PAGES' environment variable, if set: "0"
+     or "off" disables huge pages, "on" selects the default threshold and a
+     byte count (such as "8M") sets the threshold. */
+{
+  const char *val = getenv("PLANE_POOL_HUGE_PAGES");
+  size_t num_bytes;
+  if (val == NULL)
+    return;
+  if ((strcmp(val,"off") == 0) || (strcmp(val,"0") == 0))
+    huge_threshold = 0;
+  else if (strcmp(val,"on") == 0)
+    huge_threshold = POOL_HUGE_DEFAULT;
+  else if (parse_bytes(val,&num_bytes))
+    huge_threshold = num_bytes;
+  else
+    fprintf(stderr,"Ignoring unrecognized PLANE_POOL_HUGE_PAGES=%s\n",val);
+}
+
+/*****************************************************************************/
+/* STATIC                         free_block                                 */
+/*****************************************************************************/
+
+static void
+  free_block(float *block)
+{
+  pool_block_info *info = block_info(block);
+  int header_floats = info->header_bytes / (int) sizeof(float);
+  if (info->map_bytes == 0)
+    my_aligned_free(block - header_floats);
+  else
+#ifdef _WIN32
+    VirtualFree(block - header_floats,0,MEM_RELEASE);
+#else
+    munmap(block - header_floats,info->map_bytes);
+#endif
+}
+
+/*****************************************************************************/
+/* STATIC                       new_huge_block                               */
+/*****************************************************************************/
+
+static float *
+  new_huge_block(size_t num_bytes, int size_class)
+  /* Maps a block backed by huge pages if possible, returning NULL if the
+     memory cannot be mapped at all, so that the caller can fall back to
+     `my_aligned_alloc'. */
+{
+  int header_bytes = POOL_HEADER_BYTES(POOL_ALIGNMENT);
+  size_t map_bytes = (header_bytes + num_bytes + POOL_HUGE_PAGE-1) &
+    ~(POOL_HUGE_PAGE-1);
+  char *base;
+  int granted = 0;
+#ifdef _WIN32
+  // Large pages need the "lock pages in memory" privilege; without it the
+  // first call fails and we settle for ordinary pages
+  size_t large = GetLargePageMinimum();
+  base = NULL;
+  if (large != 0)
+    {
+      size_t large_bytes = (map_bytes + large-1) & ~(large-1);
+      base = (char *) VirtualAlloc(NULL,large_bytes,
+                                   MEM_RESERVE|MEM_COMMIT|MEM_LARGE_PAGES,
+                                   PAGE_READWRITE);
+      if (base != NULL)
+        { map_bytes = large_bytes;  granted = 1; }
+    }
+  if (base == NULL)
+    base = (char *) VirtualAlloc(NULL,map_bytes,MEM_RESERVE|MEM_COMMIT,
+                                 PAGE_READWRITE);
+  if (base == NULL)
+    return NULL;
+#else
+  // Over-allocate by one huge page, then trim both ends so that the
+  // mapping starts and ends on huge page boundaries
+  size_t span = map_bytes + POOL_HUGE_PAGE;
+  char *raw = (char *) mmap(NULL,span,PROT_READ|PROT_WRITE,
+                            MAP_PRIVATE|MAP_ANONYMOUS,-1,0);
+  if (raw == (char *) MAP_FAILED)
+    return NULL;
+  base = (char *)((((size_t) raw) + POOL_HUGE_PAGE-1) & ~(POOL_HUGE_PAGE-1));
+  if (base > raw)
+    munmap(raw,(size_t)(base-raw));
+  if ((base + map_bytes) < (raw + span))
+    munmap(base+map_bytes,(size_t)((raw+span) - (base+map_bytes)));
+#  ifdef MADV_HUGEPAGE
+  if (madvise(base,map_bytes,MADV_HUGEPAGE) == 0)
+    granted = 1; // Must happen before the pages are first touched
+#  endif
+#endif
+  float *block = (float *)(base + header_bytes);
+  pool_block_info *info = block_info(block);
+  info->map_bytes = map_bytes;
+  info->size_class = size_class;
+  info->header_bytes = header_bytes;
+  info->huge_granted = granted;
+  return block;
+}
+
+/*****************************************************************************/
+/* STATIC                          new_block                                 */
+/*****************************************************************************/
+
+static float *
+  new_block(size_t num_bytes, int size_class, int alignment)
+{
+  std::call_once(huge_env_once,read_huge_page_env);
+  size_t threshold = huge_threshold;
+  if ((threshold != 0) && (num_bytes >= threshold) &&
+      (alignment <= POOL_ALIGNMENT))
+    {
+      float *block = new_huge_block(num_bytes,size_class);
+      if (block != NULL)
+        return block;
+    }
+  int header_bytes = POOL_HEADER_BYTES(alignment);
+  float *base = my_aligned_alloc((header_bytes + num_bytes) / sizeof(float),
+                                 alignment);
+  float *block = base + header_bytes / (int) sizeof(float);
+  pool_block_info *info = block_info(block);
+  info->map_bytes = 0;
+  info->size_class = size_class;
+  info->header_bytes = header_bytes;
+  info->huge_granted = 0;
+  return block;
+}
+
+/*****************************************************************************/
+/*                           pool_cache::~pool_cache                         */
+/*****************************************************************************/
+
+pool_cache::~pool_cache()
+{
+  std::lock_guard<std::mutex> lock(shared.mutex);
+  for (int c=0; c < POOL_NUM_CLASSES; c++)
+    shared.lists[c].insert(shared.lists[c].end(),
+                           lists[c].begin(),lists[c].end());
+}
+
+/*****************************************************************************/
+/*                          pool_shared::~pool_shared                        */
+/*****************************************************************************/
+
+pool_shared::~pool_shared()
+{
+  for (int c=0; c < POOL_NUM_CLASSES; c++)
+    for (size_t n=0; n < lists[c].size(); n++)
+      free_block(lists[c][n]);
+}
+
+/* ========================================================================= */
+/*                             External Functions                            */
+/* ========================================================================= */
+
+/*****************************************************************************/
+/*                             plane_pool__take                              */
+/*****************************************************************************/
+
+float *plane_pool__take(size_t num_floats, int alignment)
+{
+  size_t num_bytes = num_floats * sizeof(float);
+  if (alignment > POOL_ALIGNMENT)
+    { // Rare; such blocks bypass the pool
+      num_bytes = (num_bytes + 15) & ~((size_t) 15);
+      return new_block(num_bytes,-1,alignment);
+    }
+  int c = find_class(num_bytes);
+  std::vector<float *> &local = cache.lists[c];
+  float *block = NULL;
+  if (!local.empty())
+    { block = local.back();  local.pop_back(); }
+  else
+    {
+      std::lock_guard<std::mutex> lock(shared.mutex);
+      if (!shared.lists[c].empty())
+        { block = shared.lists[c].back();  shared.lists[c].pop_back(); }
+    }
+  if (block == NULL)
+    return new_block(class_bytes(c),c,POOL_ALIGNMENT);
+  idle_bytes -= class_bytes(c);
+  return block;
+}
+
+/*****************************************************************************/
+/*                          plane_pool__block_bytes                          */
+/*****************************************************************************/
+
+size_t plane_pool__block_bytes(size_t num_floats, int alignment)
+{
+  size_t num_bytes = num_floats * sizeof(float);
+  if (alignment > POOL_ALIGNMENT)
+    return POOL_HEADER_BYTES(alignment) +
+      ((num_bytes + 15) & ~((size_t) 15));
+  num_bytes = class_bytes(find_class(num_bytes));
+  int header_bytes = POOL_HEADER_BYTES(POOL_ALIGNMENT);
+  std::call_once(huge_env_once,read_huge_page_env);
+  size_t threshold = huge_threshold;
+  if ((threshold != 0) && (num_bytes >= threshold))
+    return (header_bytes + num_bytes + POOL_HUGE_PAGE-1) &
+      ~(POOL_HUGE_PAGE-1); // As mapped by `new_huge_block'
+  return header_bytes + num_bytes;
+}
+
+/*****************************************************************************/
+/*                            plane_pool__release                            */
+/*****************************************************************************/
+
+void plane_pool__release(float *block)
+{
+  if (block == NULL)
+    return;
+  int c = block_info(block)->size_class;
+  if (c < 0)
+    { free_block(block);  return; }
+  size_t bytes = class_bytes(c);
+  if ((idle_bytes += bytes) > idle_limit)
+    { // Over the limit; give the memory back instead
+      idle_bytes -= bytes;
+      free_block(block);
+      return;
+    }
+  std::vector<float *> &local = cache.lists[c];
+  if (local.size() < POOL_CACHE_BLOCKS)
+    local.push_back(block);
+  else
+    {
+      std::lock_guard<std::mutex> lock(shared.mutex);
+      shared.lists[c].push_back(block);
+    }
+}
+
+/*****************************************************************************/
+/*                           plane_pool__set_limit                           */
+/*****************************************************************************/
+
+void plane_pool__set_limit(size_t max_idle_bytes)
+{
+  idle_limit = max_idle_bytes;
+}
+
+/*****************************************************************************/
+/*                              plane_pool__trim                             */
+/*****************************************************************************/
+
+void plane_pool__trim()
+{
+  std::vector<float *> victims;
+  for (int c=0; c < POOL_NUM_CLASSES; c++)
+    {
+      victims.insert(victims.end(),
+                     cache.lists[c].begin(),cache.lists[c].end());
+      cache.lists[c].clear();
+    }
+  {
+    std::lock_guard<std::mutex> lock(shared.mutex);
+    for (int c=0; c < POOL_NUM_CLASSES; c++)
+      {
+        victims.insert(victims.end(),
+                       shared.lists[c].begin(),shared.lists[c].end());
+        shared.lists[c].clear();
+      }
+  }
+  for (size_t n=0; n < victims.size(); n++)
+    {
+      idle_bytes -= class_bytes(block_info(victims[n])->size_class);
+      free_block(victims[n]);
+    }
+}
+
+/*****************************************************************************/
+/*                       plane_pool__set_huge_threshold                      */
+/*****************************************************************************/
+
+void plane_pool__set_huge_threshold(size_t min_bytes)
+{
+  std::call_once(huge_env_once,read_huge_page_env);
+  huge_threshold = min_bytes;
+}
+
+/*****************************************************************************/
+/*                        plane_pool__huge_page_bytes                        */
+/*****************************************************************************/
+
+long long plane_pool__huge_page_bytes(const float *block)
+{
+  pool_block_info *info = block_info((float *) block);
+  if ((info->map_bytes == 0) || !info->huge_granted)
+    return 0;
+#ifdef _WIN32
+  return (long long) info->map_bytes; // Large pages are all-or-nothing
+#else
+  // Find the mapping which holds `block' in /proc/self/smaps and read its
+  // "AnonHugePages" line.  Neighbouring mappings with the same attributes
+  // may have been merged with ours, so clip to our own length.
+  FILE *fp = fopen("/proc/self/smaps","r");
+  if (fp == NULL)
+    return -1;
+  size_t addr = (size_t) block;
+  bool in_ours = false;
+  long long result = -1;
+  char line[256];
+  while (fgets(line,sizeof(line),fp) != NULL)
+    {
+      unsigned long long start, end, kb;
+      if (sscanf(line,"%llx-%llx ",&start,&end) == 2)
+        in_ours = (addr >= start) && (addr < end);
+      else if (in_ours && (sscanf(line,"AnonHugePages: %llu kB",&kb) == 1))
+        {
+          result = (long long)(kb << 10);
+          if (result > (long long) info->map_bytes)
+            result = (long long) info->map_bytes;
+          break;
+        }
+    }
+  fclose(fp);
+  return result;
+#endif
+}
@@ -0,0 +1,336 @@
+/*****************************************************************************/
+// File: simd_filter.cpp
+/*****************************************************************************/
+
+#include <immintrin.h>
+#include "simd_filter.h"
+#include "cpu_features.h"
+
+typedef void (*vertical_fn)(float *, const float * const *, const float *,
+                            int, int);
+typedef void (*horizontal_fn)(float *, const float *, const float *, int,
+                              int);
+
+/* ========================================================================= */
+/*                             Internal Functions                            */
+/* ========================================================================= */
+
+/*****************************************************************************/
+/* STATIC                        vertical_tail                               */
+/*****************************************************************************/
+
+static inline void
+  vertical_tail(float *out, const float * const *src, const float *taps,
+                int num_taps, int c, int width)
+  /* Finishes `simd_filter__vertical' from sample `c', one at a time. */
+{
+  for (; c < width; c++)
+    {
+      float sum = 0.0F;
+      for (int t=0; t < num_taps; t++)
+        sum += taps[t] * src[t][c];
+      out[c] = sum;
+    }
+}
+
+/*****************************************************************************/
+/* STATIC                       horizontal_tail                              */
+/*****************************************************************************/
+
+static inline void
+  horizontal_tail(float *out, const float *in, const float *taps,
+                  int extent, int c, int width)
+  /* Finishes `simd_filter__horizontal' from sample `c', one at a time. */
+{
+  for (; c < width; c++)
+    {
+      float sum = 0.0F;
+      for (int x=-extent; x <= extent; x++)
+        sum += taps[x] * in[c+x];
+      out[c] = sum;
+    }
+}
+
+/*****************************************************************************/
+/* STATIC                        vertical_sse2                               */
+/*****************************************************************************/
+
+static void
+  vertical_sse2(float *out, const float * const *src, const float *taps,
+                int num_taps, int width)
+{
+  int c = 0;
+  for (; (c+4) <= width; c += 4)
+    {
+      __m128 sum = _mm_setzero_ps();
+      for (int t=0; t < num_taps; t++)
+        sum = _mm_add_ps(sum,_mm_mul_ps(_mm_set1_ps(taps[t]),
+                                        _mm_loadu_ps(src[t]+c)));
+      _mm_storeu_ps(out+c,sum);
+    }
+  vertical_tail(out,src,taps,num_taps,c,width);
+}
+
+/*****************************************************************************/
+/* STATIC                       horizontal_sse2                              */
+/*****************************************************************************/
+
+static void
+  horizontal_sse2(float *out, const float *in, const float *taps,
+                  int extent, int width)
+{
+  int c = 0;
+  for (; (c+4) <= width; c += 4)
+    {
+      __m128 sum = _mm_setzero_ps();
+      for (int x=-extent; x <= extent; x++)
+        sum = _mm_add_ps(sum,_mm_mul_ps(_mm_set1_ps(taps[x]),
+                                        _mm_loadu_ps(in+c+x)));
+      _mm_storeu_ps(out+c,sum);
+    }
+  horizontal_tail(out,in,taps,extent,c,width);
+}
+
+/*****************************************************************************/
+/* STATIC                      horizontal_ssse3                              */
+/*****************************************************************************/
+
+SIMD_TARGET_SSSE3 static void
+  horizontal_ssse3(float *out, const float *in, const float *taps,
+                   int extent, int width)
+  /* Same as `horizontal_sse2', but if `in' is 16-byte aligned only aligned
+     loads are used: each block of 4 input samples is loaded once per
+     output vector, and the windows which straddle two blocks are formed
+     with `_mm_alignr_epi8'.  The result is identical, since the taps are
+     applied in the same order. */
+{
+  if ((((size_t) in) & 15) != 0)
+    { horizontal_sse2(out,in,taps,extent,width);  return; }
+  int first_x = -4*((extent+3)>>2); // Offset of the first block's start
+  int c = 0;
+  for (; (c+4) <= width; c += 4)
+    {
+      const float *bp = in + c + first_x;
+      __m128i cur = _mm_castps_si128(_mm_load_ps(bp)), next = cur;
+      __m128 sum = _mm_setzero_ps();
+      for (int x=first_x; x <= extent; x += 4, cur = next)
+        { // `cur' holds `in'[c+x] to `in'[c+x+3]; `next' the 4 after that
+          bp += 4;
+          if ((x+1) <= extent)
+            next = _mm_castps_si128(_mm_load_ps(bp));
+          if (x >= -extent)
+            sum = _mm_add_ps(sum,_mm_mul_ps(_mm_set1_ps(taps[x]),
+                                            _mm_castsi128_ps(cur)));
+          if (((x+1) >= -extent) && ((x+1) <= extent))
+            sum = _mm_add_ps(sum,_mm_mul_ps(_mm_set1_ps(taps[x+1]),
+                             _mm_castsi128_ps(_mm_alignr_epi8(next,cur,4))));
+          if (((x+2) >= -extent) && ((x+2) <= extent))
+            sum = _mm_add_ps(sum,_mm_mul_ps(_mm_set1_ps(taps[x+2]),
+                             _mm_castsi128_ps(_mm_alignr_epi8(next,cur,8))));
+          if (((x+3) >= -extent) && ((x+3) <= extent))
+            sum = _mm_add_ps(sum,_mm_mul_ps(_mm_set1_ps(taps[x+3]),
+                             _mm_castsi128_ps(_mm_alignr_epi8(next,cur,12))));
+        }
+      _mm_storeu_ps(out+c,sum);
+    }
+  horizontal_tail(out,in,taps,extent,c,width);
+}
+
+/*****************************************************************************/
+/* STATIC                        vertical_avx2                               */
+/*****************************************************************************/
+
+SIMD_TARGET_AVX2 static void
+  vertical_avx2(float *out, const float * const *src, const float *taps,
+                int num_taps, int width)
+{
+  int c = 0;
+  for (; (c+16) <= width; c += 16)
+    { // Two independent accumulators hide the latency of the FMAs
+      __m256 sum0 = _mm256_setzero_ps(), sum1 = _mm256_setzero_ps();
+      for (int t=0; t < num_taps; t++)
+        {
+          __m256 tap = _mm256_set1_ps(taps[t]);
+          sum0 = _mm256_fmadd_ps(tap,_mm256_loadu_ps(src[t]+c),sum0);
+          sum1 = _mm256_fmadd_ps(tap,_mm256_loadu_ps(src[t]+c+8),sum1);
+        }
+      _mm256_storeu_ps(out+c,sum0);
+      _mm256_storeu_ps(out+c+8,sum1);
+    }
+  for (; (c+8) <= width; c += 8)
+    {
+      __m256 sum = _mm256_setzero_ps();
+      for (int t=0; t < num_taps; t++)
+        sum = _mm256_fmadd_ps(_mm256_set1_ps(taps[t]),
+                              _mm256_loadu_ps(src[t]+c),sum);
+      _mm256_storeu_ps(out+c,sum);
+    }
+  vertical_tail(out,src,taps,num_taps,c,width);
+}
+
+/*****************************************************************************/
+/* STATIC                       horizontal_avx2                              */
+/*****************************************************************************/
+
+SIMD_TARGET_AVX2 static void
+  horizontal_avx2(float *out, const float *in, const float *taps,
+                  int extent, int width)
+{
+  int c = 0;
+  for (; (c+16) <= width; c += 16)
+    {
+      __m256 sum0 = _mm256_setzero_ps(), sum1 = _mm256_setzero_ps();
+      for (int x=-extent; x <= extent; x++)
+        {
+          __m256 tap = _mm256_set1_ps(taps[x]);
+          sum0 = _mm256_fmadd_ps(tap,_mm256_loadu_ps(in+c+x),sum0);
+          sum1 = _mm256_fmadd_ps(tap,_mm256_loadu_ps(in+c+8+x),sum1);
+        }
+      _mm256_storeu_ps(out+c,sum0);
+      _mm256_storeu_ps(out+c+8,sum1);
+    }
+  for (; (c+8) <= width; c += 8)
+    {
+      __m256 sum = _mm256_setzero_ps();
+      for (int x=-extent; x <= extent; x++)
+        sum = _mm256_fmadd_ps(_mm256_set1_ps(taps[x]),
+                              _mm256_loadu_ps(in+c+x),sum);
+      _mm256_storeu_ps(out+c,sum);
+    }
+  horizontal_tail(out,in,taps,extent,c,width);
+}
+
+/*****************************************************************************/
+/* STATIC                       vertical_avx512                              */
+/*****************************************************************************/
+
+SIMD_TARGET_AVX512 static void
+  vertical_avx512(float *out, const float * const *src, const float *taps,
+                  int num_taps, int width)
+{
+  int c = 0;
+  for (; (c+32) <= width; c += 32)
+    {
+      __m512 sum0 = _mm512_setzero_ps(), sum1 = _mm512_setzero_ps();
+      for (int t=0; t < num_taps; t++)
+        {
+          __m512 tap = _mm512_set1_ps(taps[t]);
+          sum0 = _mm512_fmadd_ps(tap,_mm512_loadu_ps(src[t]+c),sum0);
+          sum1 = _mm512_fmadd_ps(tap,_mm512_loadu_ps(src[t]+c+16),sum1);
+        }
+      _mm512_storeu_ps(out+c,sum0);
+      _mm512_storeu_ps(out+c+16,sum1);
+    }
+  for (; c < width; c += 16)
+    { // Masked loads and stores finish the row without a scalar tail
+      __mmask16 mask = (__mmask16) 0xFFFF;
+      if ((width-c) < 16)
+        mask = (__mmask16)((1u << (width-c)) - 1);
+      __m512 sum = _mm512_setzero_ps();
+      for (int t=0; t < num_taps; t++)
+        sum = _mm512_fmadd_ps(_mm512_set1_ps(taps[t]),
+                              _mm512_maskz_loadu_ps(mask,src[t]+c),sum);
+      _mm512_mask_storeu_ps(out+c,mask,sum);
+    }
+}
+
+/*****************************************************************************/
+/* STATIC                      horizontal_avx512                             */
+/*****************************************************************************/
+
+SIMD_TARGET_AVX512 static void
+  horizontal_avx512(float *out, const float *in, const float *taps,
+                    int extent, int width)
+{
+  int c = 0;
+  for (; (c+32) <= width; c += 32)
+    {
+      __m512 sum0 = _mm512_setzero_ps(), sum1 = _mm512_setzero_ps();
+      for (int x=-extent; x <= extent; x++)
+        {
+          __m512 tap = _mm512_set1_ps(taps[x]);
+          sum0 = _mm512_fmadd_ps(tap,_mm512_loadu_ps(in+c+x),sum0);
+          sum1 = _mm512_fmadd_ps(tap,_mm512_loadu_ps(in+c+16+x),sum1);
+        }
+      _mm512_storeu_ps(out+c,sum0);
+      _mm512_storeu_ps(out+c+16,sum1);
+    }
+  for (; c < width; c += 16)
+    {
+      __mmask16 mask = (__mmask16) 0xFFFF;
+      if ((width-c) < 16)
+        mask = (__mmask16)((1u << (width-c)) - 1);
+      __m512 sum = _mm512_setzero_ps();
+      for (int x=-extent; x <= extent; x++)
+        sum = _mm512_fmadd_ps(_mm512_set1_ps(taps[x]),
+                              _mm512_maskz_loadu_ps(mask,in+c+x),sum);
+      _mm512_mask_storeu_ps(out+c,mask,sum);
+    }
+}
+
+/*****************************************************************************/
+/* STATIC                       select_kernels                               */
+/*****************************************************************************/
+
+struct filter_kernels {
+    int level;
+    vertical_fn vertical;
+    horizontal_fn horizontal;
+  };
+
+static filter_kernels
+  select_kernels()
+{
+  filter_kernels k;
+  k.level = cpu_simd_level();
+  if (k.level >= CPU_SIMD_AVX512)
+    { k.level = CPU_SIMD_AVX512;
+      k.vertical = vertical_avx512;  k.horizontal = horizontal_avx512; }
+  else if (k.level >= CPU_SIMD_AVX2)
+    { k.vertical = vertical_avx2;  k.horizontal = horizontal_avx2; }
+  else if (k.level >= CPU_SIMD_SSSE3)
+    { k.vertical = vertical_sse2;  k.horizontal = horizontal_ssse3; }
+  else
+    { k.vertical = vertical_sse2;  k.horizontal = horizontal_sse2; }
+  return k;
+}
+
+static const filter_kernels &
+  kernels()
+{
+  static const filter_kernels k = select_kernels();
+  return k;
+}
+
+/* ========================================================================= */
+/*                             External Functions                            */
+/* ========================================================================= */
+
+/*****************************************************************************/
+/*                           simd_filter__vertical                           */
+/*****************************************************************************/
+
+void simd_filter__vertical(float *out, const float * const *src,
+                           const float *taps, int num_taps, int width)
+{
+  kernels().vertical(out,src,taps,num_taps,width);
+}
+
+/*****************************************************************************/
+/*                          simd_filter__horizontal                          */
+/*****************************************************************************/
+
+void simd_filter__horizontal(float *out, const float *in, const float *taps,
+                             int extent, int width)
+{
+  kernels().horizontal(out,in,taps,extent,width);
+}
+
+/*****************************************************************************/
+/*                            simd_filter__level                             */
+/*****************************************************************************/
+
+int simd_filter__level()
+{
+  return kernels().level;
+}
@@ -0,0 +1,328 @@
+/*****************************************************************************/
+// File: typed_image_comps.cpp
+/*****************************************************************************/
+
+#include <string.h>
+#include <emmintrin.h>
+#include "typed_image_comps.h"
+
+/* ========================================================================= */
+/*                             Internal Functions                            */
+/* ========================================================================= */
+
+/*****************************************************************************/
+/* STATIC                         div_round                                  */
+/*****************************************************************************/
+
+static inline int32_t
+  div_round(int32_t sum, int32_t divisor)
+  /* Returns `sum'/`divisor' rounded to the nearest integer, with halves
+     rounded away from zero; `divisor' must be positive. */
+{
+  int32_t half = divisor >> 1;
+  return (sum >= 0)?((sum + half) / divisor):-((half - sum) / divisor);
+}
+
+static inline float
+  div_round(float sum, int32_t divisor)
+{
+  return sum * (1.0F / (float) divisor);
+}
+
+/*****************************************************************************/
+/* STATIC                      box_vertical_sums                             */
+/*****************************************************************************/
+
+template<class T> static void
+  box_vertical_sums(const T *in, int in_stride, int extent, int num_cols,
+                    typename my_sample_traits<T>::acc_type *sums)
+  /* Writes to `sums'[c] the sum of the 2*`extent'+1 samples of column c,
+     centred on the row which starts at `in', for each c in the range
+     -`extent' to `num_cols'+`extent'-1. */
+{
+  in -= extent;  sums -= extent;  num_cols += 2*extent;
+  const T *ip = in - ((ptrdiff_t) in_stride)*extent;
+  for (int c=0; c < num_cols; c++)
+    sums[c] = my_sample_traits<T>::to_acc(ip[c]);
+  for (int y=-extent+1; y <= extent; y++)
+    {
+      ip += in_stride;
+      for (int c=0; c < num_cols; c++)
+        sums[c] += my_sample_traits<T>::to_acc(ip[c]);
+    }
+}
+
+template<> void
+  box_vertical_sums<my_u8>(const my_u8 *in, int in_stride, int extent,
+                           int num_cols, int32_t *sums)
+  /* 8-bit specialization: 16 columns at a time, summed in 16-bit lanes,
+     which cannot overflow for up to 257 rows. */
+{
+  in -= extent;  sums -= extent;  num_cols += 2*extent;
+  const my_u8 *ip = in - ((ptrdiff_t) in_stride)*extent;
+  __m128i zero = _mm_setzero_si128();
+  int c = 0;
+  for (; c <= (num_cols-16); c += 16)
+    {
+      __m128i lo = zero, hi = zero;
+      const my_u8 *sp = ip + c;
+      for (int y=-extent; y <= extent; y++, sp+=in_stride)
+        {
+          __m128i val = _mm_loadu_si128((const __m128i *) sp);
+          lo = _mm_add_epi16(lo,_mm_unpacklo_epi8(val,zero));
+          hi = _mm_add_epi16(hi,_mm_unpackhi_epi8(val,zero));
+        }
+      __m128i *dp = (__m128i *)(sums + c);
+      _mm_storeu_si128(dp+0,_mm_unpacklo_epi16(lo,zero));
+      _mm_storeu_si128(dp+1,_mm_unpackhi_epi16(lo,zero));
+      _mm_storeu_si128(dp+2,_mm_unpacklo_epi16(hi,zero));
+      _mm_storeu_si128(dp+3,_mm_unpackhi_epi16(hi,zero));
+    }
+  for (; c < num_cols; c++)
+    {
+      const my_u8 *sp = ip + c;
+      int32_t sum = 0;
+      for (int y=-extent; y <= extent; y++, sp+=in_stride)
+        sum += *sp;
+      sums[c] = sum;
+    }
+}
+
+/* ========================================================================= */
+/*                             External Functions                            */
+/* ========================================================================= */
+
+/*****************************************************************************/
+/*                              my_f16_to_float                              */
+/*****************************************************************************/
+
+float my_f16_to_float(my_f16 val)
+{
+  uint32_t sign = ((uint32_t)(val.bits & 0x8000)) << 16;
+  uint32_t exp = (val.bits >> 10) & 0x1F;
+  uint32_t mant = val.bits & 0x3FF;
+  uint32_t bits;
+  if (exp == 0x1F)
+    bits = sign | 0x7F800000 | (mant << 13); // Infinity or NaN
+  else if (exp != 0)
+    bits = sign | ((exp + 112) << 23) | (mant << 13);
+  else if (mant == 0)
+    bits = sign; // Signed zero
+  else
+    { // Subnormal; normalize the mantissa
+      exp = 113;
+      while ((mant & 0x400) == 0)
+        { mant <<= 1;  exp--; }
+      bits = sign | (exp << 23) | ((mant & 0x3FF) << 13);
+    }
+  float result;
+  memcpy(&result,&bits,4);
+  return result;
+}
+
+/*****************************************************************************/
+/*                              my_float_to_f16                              */
+/*****************************************************************************/
+
+my_f16 my_float_to_f16(float val)
+{
+  uint32_t bits;
+  memcpy(&bits,&val,4);
+  uint16_t sign = (uint16_t)((bits >> 16) & 0x8000);
+  int exp = (int)((bits >> 23) & 0xFF);
+  uint32_t mant = bits & 0x7FFFFF;
+  my_f16 result;
+  if (exp == 0xFF)
+    { // Infinity or NaN; keep NaNs quiet and non-zero
+      result.bits = sign | 0x7C00 | ((mant != 0)?(0x200|(mant >> 13)):0);
+      return result;
+    }
+  exp -= 112; // Rebias from 127 to 15
+  if (exp >= 0x1F)
+    { result.bits = sign | 0x7C00;  return result; } // Overflow
+  if (exp <= 0)
+    { // Subnormal or zero result
+      if (exp < -10)
+        { result.bits = sign;  return result; }
+      mant |= 0x800000; // Implicit leading 1
+      int shift = 14 - exp;
+      uint32_t half = mant >> shift;
+      uint32_t rest = mant & ((1u << shift) - 1);
+      uint32_t midpoint = 1u << (shift-1);
+      if ((rest > midpoint) || ((rest == midpoint) && (half & 1)))
+        half++;
+      result.bits = sign | (uint16_t) half;
+      return result;
+    }
+  uint32_t half = (((uint32_t) exp) << 10) | (mant >> 13);
+  uint32_t rest = mant & 0x1FFF;
+  if ((rest > 0x1000) || ((rest == 0x1000) && (half & 1)))
+    half++; // May carry into the exponent, which is still correct
+  result.bits = sign | (uint16_t) half;
+  return result;
+}
+
+/*****************************************************************************/
+/*                            my_convert_samples                             */
+/*****************************************************************************/
+
+template<class T> void
+  my_convert_samples(const my_image_view &src, const my_typed_view<T> &dst)
+{
+  assert((dst.width >= src.width) && (dst.height >= src.height));
+  for (int r=0; r < src.height; r++)
+    {
+      const float *sp = src.row(r);
+      T *dp = dst.row(r);
+      for (int c=0; c < src.width; c++)
+        dp[c] = my_sample_traits<T>::from_float(sp[c]);
+    }
+}
+
+template<class T> void
+  my_convert_samples(const my_typed_view<T> &src, const my_image_view &dst)
+{
+  assert((dst.width >= src.width) && (dst.height >= src.height));
+  for (int r=0; r < src.height; r++)
+    {
+      const T *sp = src.row(r);
+      float *dp = dst.row(r);
+      for (int c=0; c < src.width; c++)
+        dp[c] = my_sample_traits<T>::to_float(sp[c]);
+    }
+}
+
+/*****************************************************************************/
+/*                       my_perform_boundary_extension                       */
+/*****************************************************************************/
+
+template<class T> void
+  my_perform_boundary_extension(const my_typed_view<T> &comp)
+{
+  int border = comp.border;
+  for (int r=0; r < comp.height; r++)
+    { // First extend each row to the left and to the right
+      T *row = comp.row(r);
+      T left = row[0], right = row[comp.width-1];
+      for (int c=1; c <= border; c++)
+        { row[-c] = left;  row[comp.width-1+c] = right; }
+    }
+  size_t row_bytes = sizeof(T) * (size_t)(comp.width + 2*border);
+  T *first_line = comp.row(0) - border;
+  T *last_line = comp.row(comp.height-1) - border;
+  for (int r=1; r <= border; r++)
+    { // Now copy the extended first and last rows outwards
+      memcpy(first_line - ((ptrdiff_t) r)*comp.stride,first_line,row_bytes);
+      memcpy(last_line + ((ptrdiff_t) r)*comp.stride,last_line,row_bytes);
+    }
+}
+
+/*****************************************************************************/
+/*                              my_typed_filter                              */
+/*****************************************************************************/
+
+template<class T> void
+  my_typed_filter(const my_typed_view<T> &out, const my_typed_view<T> &in)
+{
+  typedef typename my_sample_traits<T>::acc_type acc_type;
+  const int FILTER_EXTENT = 4;
+  const int FILTER_TAPS = (2 * FILTER_EXTENT + 1);
+
+  // Check for consistent dimensions
+  assert(in.border >= FILTER_EXTENT);
+  assert((out.height <= in.height) && (out.width <= in.width));
+
+  // Allocate a line buffer for the vertical sums, including the columns
+  // to either side which the horizontal pass needs
+  int buf_cols = out.width + 2*FILTER_EXTENT;
+  size_t buf_floats = (sizeof(acc_type)*buf_cols + sizeof(float)-1) /
+    sizeof(float);
+  float *handle = plane_pool__take(buf_floats,MY_COMP_ALIGNMENT);
+  acc_type *sums = ((acc_type *) handle) + FILTER_EXTENT;
+
+  for (int r=0; r < out.height; r++)
+    {
+      // 1. Vertical sums of 9 rows, over the row and its margins
+      box_vertical_sums<T>(in.row(r),in.stride,FILTER_EXTENT,out.width,sums);
+
+      // 2. Horizontal sums of 9 vertical sums; for integer samples these
+      // are exact, so the only rounding is in the final division
+      T *op = out.row(r);
+      for (int c=0; c < out.width; c++)
+        {
+          acc_type total = sums[c-FILTER_EXTENT];
+          for (int x=-FILTER_EXTENT+1; x <= FILTER_EXTENT; x++)
+            total += sums[c+x];
+          op[c] = my_sample_traits<T>::from_acc(
+                    div_round(total,FILTER_TAPS*FILTER_TAPS));
+        }
+    }
+  plane_pool__release(handle);
+}
+
+/*****************************************************************************/
+/*                      my_typed_bilinear_interpolation                      */
+/*****************************************************************************/
+
+template<class T> void
+  my_typed_bilinear_interpolation(const my_typed_view<T> &out,
+                                  const my_typed_view<T> &in)
+{
+  typedef typename my_sample_traits<T>::acc_type acc_type;
+  const int scale = 3;
+  assert(in.border >= 1);
+  assert((out.height >= in.height*scale) && (out.width >= in.width*scale));
+
+  // One line of vertically interpolated samples, in units of 1/3, with
+  // one extra sample for the right-hand neighbour of the last column
+  size_t buf_floats = (sizeof(acc_type)*(in.width+1) + sizeof(float)-1) /
+    sizeof(float);
+  float *handle = plane_pool__take(buf_floats,MY_COMP_ALIGNMENT);
+  acc_type *vline = (acc_type *) handle;
+
+  int output_height = in.height * scale;
+  for (int y=0; y < output_height; y++)
+    {
+      int n2 = y / scale; // vertical index
+      acc_type a = (acc_type)(y - n2*scale); // sigma_2 = a/3
+      const T *top = in.row(n2), *bottom = in.row(n2+1);
+      for (int n=0; n <= in.width; n++)
+        vline[n] = ((acc_type) scale - a) * my_sample_traits<T>::to_acc(top[n])
+                 + a * my_sample_traits<T>::to_acc(bottom[n]);
+
+      // Each group of 3 outputs lies between `vline[n]' and `vline[n+1]'
+      T *op = out.row(y);
+      for (int n=0; n < in.width; n++, op+=scale)
+        {
+          acc_type left = vline[n], right = vline[n+1];
+          op[0] = my_sample_traits<T>::from_acc(div_round(scale*left,
+                                                           scale*scale));
+          op[1] = my_sample_traits<T>::from_acc(div_round(2*left + right,
+                                                           scale*scale));
+          op[2] = my_sample_traits<T>::from_acc(div_round(left + 2*right,
+                                                           scale*scale));
+        }
+    }
+  plane_pool__release(handle);
+}
+
+/*****************************************************************************/
+/*                          Explicit instantiations                          */
+/*****************************************************************************/
+
+#define MY_INSTANTIATE_TYPED_KERNELS(T) \
+  template void my_convert_samples<T>(const my_image_view &, \
+                                      const my_typed_view<T> &); \
+  template void my_convert_samples<T>(const my_typed_view<T> &, \
+                                      const my_image_view &); \
+  template void my_perform_boundary_extension<T>(const my_typed_view<T> &); \
+  template void my_typed_filter<T>(const my_typed_view<T> &, \
+                                   const my_typed_view<T> &); \
+  template void my_typed_bilinear_interpolation<T>(const my_typed_view<T> &,\
+                                                   const my_typed_view<T> &);
+
+MY_INSTANTIATE_TYPED_KERNELS(my_u8)
+MY_INSTANTIATE_TYPED_KERNELS(my_u16)
+MY_INSTANTIATE_TYPED_KERNELS(my_fix16)
+MY_INSTANTIATE_TYPED_KERNELS(my_f16)
+MY_INSTANTIATE_TYPED_KERNELS(float)